@@ -0,0 +1,407 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Benchmark for the boot animation. Generates test logos, plays them with
+ * the real hildon-welcome binary a number of times and reports the timings
+ * from its boot trace, along with wall time and peak RSS per run. The
+ * media cache, video sink choice, readahead manifest, completion flag and
+ * control socket of the runs are kept in a temporary directory, and the
+ * caches are filled before the first run as --update-cache fills the
+ * system ones.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include "trace.h"
+
+#define BENCH_DEFAULT_BINARY "./hildon-welcome"
+#define BENCH_DEFAULT_ITERATIONS 5
+#define BENCH_LOGOS 3
+#define BENCH_LOGO_FRAMES 50
+#define BENCH_LOGO_DURATION 2000
+#define BENCH_MEDIA_PIPELINE \
+  "videotestsrc num-buffers=%d pattern=%d ! video/x-raw-yuv,width=800,height=480,framerate=25/1 ! " \
+  "jpegenc ! avimux ! filesink location=\"%s\""
+/* Same sink name as the player uses, so that the first frame is traced */
+#define BENCH_FAKESINK_PIPELINE " filesrc location=%s ! decodebin2 ! ffmpegcolorspace ! fakesink name=hildon-welcome-video-sink sync=true "
+
+typedef struct
+{
+  double preroll_ms;
+  double first_frame_ms;
+  double gap_ms;
+  double wall_ms;
+  double max_rss_kb;
+} BenchRun;
+
+typedef struct
+{
+  double min;
+  double max;
+  double sum;
+  int count;
+} BenchStat;
+
+static char *binary = BENCH_DEFAULT_BINARY;
+static char *media_dir = NULL;
+static int iterations = BENCH_DEFAULT_ITERATIONS;
+static gboolean fakesink = FALSE;
+
+static gboolean
+run_pipeline(const char *description)
+{
+  GstElement *pipeline = NULL;
+  GstMessage *message = NULL;
+  GstBus *bus = NULL;
+  gboolean ret = FALSE;
+
+  if ((pipeline = gst_parse_launch(description, NULL)) == NULL)
+    return FALSE;
+
+  if ((bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline))) != NULL) {
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    if ((message = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR)) != NULL) {
+      ret = (GST_MESSAGE_EOS == GST_MESSAGE_TYPE(message));
+      gst_message_unref(message);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(bus);
+  }
+  gst_object_unref(pipeline);
+
+  return ret;
+}
+
+/* Encode BENCH_LOGOS test logos into dir and write a .conf file for each */
+static gboolean
+generate_media(const char *dir)
+{
+  char *video = NULL, *conffile = NULL, *contents = NULL, *description = NULL;
+  gboolean ret = TRUE;
+  int Nix;
+
+  for (Nix = 0 ; Nix < BENCH_LOGOS && ret ; Nix++) {
+    video = g_strdup_printf("%s/logo%d.avi", dir, Nix);
+    conffile = Nix ? g_strdup_printf("%s/logo%d.conf", dir, Nix) : g_strdup_printf("%s/default.conf", dir);
+
+    description = g_strdup_printf(BENCH_MEDIA_PIPELINE, BENCH_LOGO_FRAMES, Nix, video);
+    contents = g_strdup_printf("[" PACKAGE_NAME "]\nfilename=%s\nduration=%d\n", video, BENCH_LOGO_DURATION);
+    if (!(run_pipeline(description) && g_file_set_contents(conffile, contents, -1, NULL))) {
+      g_warning("generate_media: Failed to generate %s\n", video);
+      ret = FALSE;
+    }
+
+    g_free(contents);
+    g_free(description);
+    g_free(conffile);
+    g_free(video);
+  }
+
+  return ret;
+}
+
+static void
+remove_dir(const char *dir)
+{
+  GDir *gdir = NULL;
+  const char *fname = NULL;
+  char *file = NULL;
+
+  if ((gdir = g_dir_open(dir, 0, NULL)) != NULL) {
+    while ((fname = g_dir_read_name(gdir)) != NULL) {
+      file = g_build_filename(dir, fname, NULL);
+      g_unlink(file);
+      g_free(file);
+    }
+    g_dir_close(gdir);
+  }
+  g_rmdir(dir);
+}
+
+static gint64
+trace_field(const char *line, const char *field)
+{
+  const char *str = NULL;
+
+  if ((str = strstr(line, field)) == NULL)
+    return -1;
+
+  return g_ascii_strtoll(str + strlen(field), NULL, 10);
+}
+
+/* Derive the run's timings from the trace hildon-welcome has written */
+static gboolean
+parse_trace(const char *trace_file, BenchRun *run)
+{
+  char *contents = NULL, **lines = NULL;
+  gint64 boot = -1, preroll = -1, ts, play_end = -1, gap_sum = 0;
+  GArray *first_frames = g_array_new(FALSE, FALSE, sizeof(gint64));
+  GArray *play_ends = g_array_new(FALSE, FALSE, sizeof(gint64));
+  int Nix, n_gaps = 0;
+
+  if (!g_file_get_contents(trace_file, &contents, NULL, NULL)) {
+    g_array_free(first_frames, TRUE);
+    g_array_free(play_ends, TRUE);
+    return FALSE;
+  }
+
+  lines = g_strsplit(contents, "\n", -1);
+  for (Nix = 0 ; lines[Nix] ; Nix++) {
+    ts = trace_field(lines[Nix], "\"ts\":");
+    if (strstr(lines[Nix], "{\"name\":\"main\""))
+      boot = ts;
+    else
+    if (strstr(lines[Nix], "{\"name\":\"preroll\"") && preroll < 0)
+      preroll = trace_field(lines[Nix], "\"dur\":");
+    else
+    if (strstr(lines[Nix], "{\"name\":\"first-frame\""))
+      g_array_append_val(first_frames, ts);
+    else
+    if (strstr(lines[Nix], "{\"name\":\"play\"")) {
+      play_end = ts + trace_field(lines[Nix], "\"dur\":");
+      g_array_append_val(play_ends, play_end);
+    }
+  }
+
+  /* The gap runs from the end of one logo to the first frame of the next */
+  for (Nix = 1 ; Nix < first_frames->len && Nix <= play_ends->len ; Nix++) {
+    gap_sum += g_array_index(first_frames, gint64, Nix) - g_array_index(play_ends, gint64, Nix - 1);
+    n_gaps++;
+  }
+
+  run->preroll_ms = (preroll >= 0) ? preroll / 1000.0 : -1;
+  run->first_frame_ms = (boot >= 0 && first_frames->len > 0) ? (g_array_index(first_frames, gint64, 0) - boot) / 1000.0 : -1;
+  run->gap_ms = n_gaps ? gap_sum / (n_gaps * 1000.0) : -1;
+
+  g_strfreev(lines);
+  g_free(contents);
+  g_array_free(first_frames, TRUE);
+  g_array_free(play_ends, TRUE);
+
+  return (boot >= 0);
+}
+
+/* Probe the logos and the video sinks into the caches in state_dir, so that the runs use them */
+static gboolean
+bench_update_cache(const char *conf_dir, const char *state_dir)
+{
+  char *args[] = { binary, "--update-cache", "--conf-dir", (char *)conf_dir, "--state-dir", (char *)state_dir, NULL };
+  int status = 0;
+
+  if (!g_spawn_sync(NULL, args, NULL, 0, NULL, NULL, NULL, NULL, &status, NULL) ||
+      !(WIFEXITED(status) && 0 == WEXITSTATUS(status))) {
+    g_warning("bench_update_cache: %s --update-cache failed\n", binary);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Run hildon-welcome once, passing it extra_args */
+static gboolean
+bench_run(const char *conf_dir, const char *state_dir, const char *trace_file, char **extra_args, BenchRun *run)
+{
+  GPtrArray *args = g_ptr_array_new();
+  struct rusage usage;
+  gint64 start = 0;
+  int status = 0, Nix;
+  pid_t pid;
+
+  g_ptr_array_add(args, binary);
+  g_ptr_array_add(args, "--conf-dir");
+  g_ptr_array_add(args, (gpointer)conf_dir);
+  g_ptr_array_add(args, "--state-dir");
+  g_ptr_array_add(args, (gpointer)state_dir);
+  g_ptr_array_add(args, "--trace-file");
+  g_ptr_array_add(args, (gpointer)trace_file);
+  if (fakesink) {
+    g_ptr_array_add(args, "--video=" BENCH_FAKESINK_PIPELINE);
+  }
+  for (Nix = 0 ; extra_args && extra_args[Nix] ; Nix++)
+    g_ptr_array_add(args, extra_args[Nix]);
+  g_ptr_array_add(args, NULL);
+
+  g_unlink(trace_file);
+  start = trace_now();
+  if ((pid = fork()) == 0) {
+    execv(binary, (char **)(args->pdata));
+    _exit(127);
+  }
+  g_ptr_array_free(args, TRUE);
+
+  if (pid < 0 || wait4(pid, &status, 0, &usage) != pid) {
+    g_warning("bench_run: Failed to run %s\n", binary);
+    return FALSE;
+  }
+  run->wall_ms = (trace_now() - start) / 1000.0;
+  run->max_rss_kb = usage.ru_maxrss;
+
+  if (!(WIFEXITED(status) && 0 == WEXITSTATUS(status))) {
+    g_warning("bench_run: %s failed with status %d\n", binary, status);
+    return FALSE;
+  }
+
+  return parse_trace(trace_file, run);
+}
+
+static void
+bench_stat_add(BenchStat *stat, double value)
+{
+  if (value < 0) return;
+
+  if (0 == stat->count || value < stat->min)
+    stat->min = value;
+  if (0 == stat->count || value > stat->max)
+    stat->max = value;
+  stat->sum += value;
+  stat->count++;
+}
+
+static void
+bench_stat_print(const char *name, const char *unit, BenchStat *stat)
+{
+  if (stat->count)
+    printf("%-20s %10.1f %10.1f %10.1f %s\n", name, stat->min, stat->sum / stat->count, stat->max, unit);
+  else
+    printf("%-20s %10s %10s %10s\n", name, "-", "-", "-");
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionEntry options[] = {
+    {
+      .long_name = "binary",
+      .short_name = 'b',
+      .flags = 0,
+      .arg = G_OPTION_ARG_FILENAME,
+      .arg_data = &binary,
+      .description = "The hildon-welcome binary to benchmark.",
+      .arg_description = BENCH_DEFAULT_BINARY
+    },
+    {
+      .long_name = "iterations",
+      .short_name = 'n',
+      .flags = 0,
+      .arg = G_OPTION_ARG_INT,
+      .arg_data = &iterations,
+      .description = "Number of runs.",
+      .arg_description = "N"
+    },
+    {
+      .long_name = "media",
+      .short_name = 'm',
+      .flags = 0,
+      .arg = G_OPTION_ARG_FILENAME,
+      .arg_data = &media_dir,
+      .description = "Play the .conf files in this directory instead of generated test logos.",
+      .arg_description = "DIR"
+    },
+    {
+      .long_name = "fakesink",
+      .short_name = 'f',
+      .flags = 0,
+      .arg = G_OPTION_ARG_NONE,
+      .arg_data = &fakesink,
+      .description = "Decode into fakesinks instead of rendering.",
+      .arg_description = NULL
+    },
+    { NULL }
+  };
+
+  GOptionContext *ctx;
+  GError *err = NULL;
+  BenchStat preroll = { 0 }, first_frame = { 0 }, gap = { 0 }, wall = { 0 }, rss = { 0 };
+  BenchRun run;
+  char *tmp_dir = NULL, *conf_dir = NULL, *trace_file = NULL, **extra_args = NULL;
+  int Nix, failures = 0;
+
+  ctx = g_option_context_new("[-- HILDON-WELCOME OPTIONS]");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err))
+    g_error ("main: Error parsing command line: %s\n", err ? err->message : "Unknown error\n");
+  g_option_context_free (ctx);
+
+  if ((tmp_dir = g_strdup_printf("%s/hildon-welcome-bench-XXXXXX", g_get_tmp_dir())) == NULL || !mkdtemp(tmp_dir))
+    g_error("main: Failed to create a temporary directory\n");
+
+  if (media_dir)
+    conf_dir = g_strdup(media_dir);
+  else {
+    conf_dir = g_strdup(tmp_dir);
+    if (!generate_media(conf_dir)) {
+      remove_dir(tmp_dir);
+      return 1;
+    }
+  }
+  trace_file = g_build_filename(tmp_dir, "trace.json", NULL);
+
+  if (!bench_update_cache(conf_dir, tmp_dir)) {
+    remove_dir(tmp_dir);
+    return 1;
+  }
+
+  /* Whatever follows -- goes to hildon-welcome */
+  extra_args = argv + 1;
+  if (extra_args[0] && g_str_equal(extra_args[0], "--"))
+    extra_args++;
+
+  for (Nix = 0 ; Nix < iterations ; Nix++) {
+    memset(&run, 0, sizeof(run));
+    if (bench_run(conf_dir, tmp_dir, trace_file, extra_args, &run)) {
+      bench_stat_add(&preroll, run.preroll_ms);
+      bench_stat_add(&first_frame, run.first_frame_ms);
+      bench_stat_add(&gap, run.gap_ms);
+      bench_stat_add(&wall, run.wall_ms);
+      bench_stat_add(&rss, run.max_rss_kb);
+    }
+    else
+      failures++;
+  }
+
+  printf("%d runs, %d failed\n", iterations, failures);
+  printf("%-20s %10s %10s %10s\n", "", "min", "mean", "max");
+  bench_stat_print("time-to-preroll", "ms", &preroll);
+  bench_stat_print("time-to-first-frame", "ms", &first_frame);
+  bench_stat_print("inter-logo gap", "ms", &gap);
+  bench_stat_print("wall time", "ms", &wall);
+  bench_stat_print("peak RSS", "kB", &rss);
+
+  remove_dir(tmp_dir);
+  g_free(trace_file);
+  g_free(conf_dir);
+  g_free(tmp_dir);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,369 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <glib.h>
+#include <gst/gst.h>
+#include "mediainfo.h"
+#include "engine.h"
+#include "trace.h"
+#include "check.h"
+
+/*
+ * Vet the configured media for boot performance: preroll each file the
+ * way the player would, with fake sinks, then decode it as fast as it
+ * goes and report what that cost.
+ */
+
+#define CHECK_PREROLL_TIMEOUT (10 * GST_SECOND)
+#define CHECK_RUN_TIMEOUT (60 * GST_SECOND)
+
+/* Resident set size in kB, from /proc/self/status */
+static long
+rss_kb()
+{
+  FILE *file = NULL;
+  char line[128];
+  long rss = 0;
+
+  if ((file = fopen("/proc/self/status", "r")) != NULL) {
+    while (fgets(line, sizeof(line), file) != NULL)
+      if (1 == sscanf(line, "VmRSS: %ld", &rss))
+        break;
+    fclose(file);
+  }
+
+  return rss;
+}
+
+/* User and system time of the whole process, in µs */
+static gint64
+cpu_us()
+{
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+  return ((gint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)) * G_USEC_PER_SEC +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* Runs in the sink's streaming thread */
+static void
+count_frame(GstElement *sink, GstBuffer *buffer, GstPad *pad, gint *p_frames)
+{
+  g_atomic_int_inc(p_frames);
+}
+
+static GstElement *
+fake_sink(gint *p_frames)
+{
+  GstElement *sink = NULL;
+
+  if ((sink = gst_element_factory_make("fakesink", NULL)) != NULL) {
+    g_object_set(G_OBJECT(sink), "sync", FALSE, NULL);
+    if (p_frames) {
+      g_object_set(G_OBJECT(sink), "signal-handoffs", TRUE, NULL);
+      g_signal_connect(G_OBJECT(sink), "handoff", (GCallback)count_frame, p_frames);
+    }
+  }
+
+  return sink;
+}
+
+static void
+append_branch(GString *chain, const char *parser, const char *decoder)
+{
+  if (parser)
+    g_string_append_printf(chain, " ! %s", parser);
+  g_string_append_printf(chain, " ! %s", decoder);
+}
+
+/* The elements the engine builds for the file */
+static char *
+describe_chain(const MediaInfo *info, gboolean want_video)
+{
+  GString *chain = g_string_new("filesrc");
+
+  if (info->demuxer)
+    g_string_append_printf(chain, " ! %s", info->demuxer);
+  if (want_video && info->video_decoder)
+    append_branch(chain, info->video_parser, info->video_decoder);
+  if (info->audio_decoder && (info->audio_caps || !want_video)) {
+    if (want_video)
+      g_string_append(chain, ", audio");
+    append_branch(chain, info->audio_parser, info->audio_decoder);
+  }
+
+  return g_string_free(chain, FALSE);
+}
+
+static void
+print_error(GstMessage *message, const char *what)
+{
+  GError *err = NULL;
+  char *debug = NULL;
+
+  if (message && GST_MESSAGE_ERROR == GST_MESSAGE_TYPE(message)) {
+    gst_message_parse_error(message, &err, &debug);
+    printf("  error: %s: %s\n", what, err ? err->message : "");
+    if (err)
+      g_error_free(err);
+    g_free(debug);
+  }
+  else
+    printf("  error: %s\n", what);
+}
+
+typedef enum
+{
+  CHECK_PREROLL_FAILED,
+  CHECK_DECODE_FAILED,
+  CHECK_OK
+} CheckResult;
+
+/* Preroll the pipeline, then run it to the end, and report. Takes the pipeline over. */
+static CheckResult
+check_pipeline(GstElement *pipeline, GstElement *video_sink, gint *p_frames)
+{
+  GstMessage *message = NULL;
+  GstStructure *structure = NULL;
+  GstCaps *caps = NULL;
+  GstPad *pad = NULL;
+  GstBus *bus = NULL;
+  gint frames = 0;
+  int width = 0, height = 0;
+  long rss_before = rss_kb(), rss_prerolled = 0;
+  gint64 start = 0, preroll_us = 0, run_us = 0, run_cpu_us = 0;
+  CheckResult ret = CHECK_PREROLL_FAILED;
+
+  bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+
+  start = trace_now();
+  gst_element_set_state(pipeline, GST_STATE_PAUSED);
+  if (GST_STATE_CHANGE_SUCCESS != gst_element_get_state(pipeline, NULL, NULL, CHECK_PREROLL_TIMEOUT)) {
+    message = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+    print_error(message, "failed to preroll");
+  }
+  else {
+    ret = CHECK_DECODE_FAILED;
+    preroll_us = trace_now() - start;
+    rss_prerolled = rss_kb();
+
+    if (video_sink)
+      if ((pad = gst_element_get_static_pad(video_sink, "sink")) != NULL) {
+        if ((caps = gst_pad_get_negotiated_caps(pad)) != NULL) {
+          if ((structure = gst_caps_get_structure(caps, 0)) != NULL) {
+            gst_structure_get_int(structure, "width", &width);
+            gst_structure_get_int(structure, "height", &height);
+          }
+          gst_caps_unref(caps);
+        }
+        gst_object_unref(pad);
+      }
+
+    /* Unsynchronised sinks: the run takes as long as decoding does */
+    start = trace_now();
+    run_cpu_us = cpu_us();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    message = gst_bus_timed_pop_filtered(bus, CHECK_RUN_TIMEOUT, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    run_cpu_us = cpu_us() - run_cpu_us;
+    run_us = trace_now() - start;
+
+    printf("  preroll: %.1f ms, memory: +%ld kB", preroll_us / 1000.0, rss_prerolled - rss_before);
+    if (width > 0 && height > 0)
+      printf(", resolution: %dx%d", width, height);
+    printf("\n");
+
+    if (!message)
+      print_error(NULL, "did not finish in time");
+    else
+    if (GST_MESSAGE_ERROR == GST_MESSAGE_TYPE(message))
+      print_error(message, "failed to decode");
+    else {
+      frames = g_atomic_int_get(p_frames);
+      if (frames > 0)
+        printf("  decode: %d frames, %.2f ms cpu per frame, %.1f ms in all\n",
+               frames, run_cpu_us / 1000.0 / frames, run_us / 1000.0);
+      else
+        printf("  decode: %.1f ms cpu, %.1f ms in all\n", run_cpu_us / 1000.0, run_us / 1000.0);
+      ret = CHECK_OK;
+    }
+  }
+
+  if (message)
+    gst_message_unref(message);
+  gst_object_unref(bus);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  return ret;
+}
+
+/* The engine's graph for the file, as the player builds it, or NULL */
+static GstElement *
+engine_pipeline(const MediaInfo *info, gboolean want_video, GstElement *video_sink)
+{
+  GstElement *pipeline = NULL, *bin = NULL;
+  char *chain = describe_chain(info, want_video);
+
+  if (want_video && info->is_image) {
+    printf("  chain: %s (still image)\n", chain);
+    bin = engine_still_bin_new(info, video_sink, 0);
+  }
+  else {
+    printf("  chain: %s\n", chain);
+    bin = engine_file_bin_new(info, video_sink, fake_sink(NULL));
+  }
+  g_free(chain);
+
+  if (bin) {
+    pipeline = gst_pipeline_new(NULL);
+    gst_bin_add(GST_BIN(pipeline), bin);
+  }
+  else
+    print_error(NULL, "failed to build the graph");
+
+  return pipeline;
+}
+
+static GstElement *
+playbin_pipeline(const MediaInfo *info, const char *path, GstElement *video_sink)
+{
+  GstElement *pipeline = NULL;
+  char *uri = g_strdup_printf("file://%s", path);
+
+  printf("  chain: %s\n", info ? "playbin2" : "playbin2 (not in the media cache, run --update-cache)");
+  if ((pipeline = gst_element_factory_make("playbin2", NULL)) != NULL)
+    g_object_set(G_OBJECT(pipeline), "uri", uri, "audio-sink", fake_sink(NULL),
+                 "video-sink", video_sink ? video_sink : fake_sink(NULL), NULL);
+  else {
+    print_error(NULL, "failed to create playbin2");
+    if (video_sink)
+      gst_object_unref(gst_object_ref_sink(video_sink));
+  }
+  g_free(uri);
+
+  return pipeline;
+}
+
+/*
+ * Report on one media file. Returns FALSE if it cannot be played. Like the
+ * player, fall back to playbin2 when the engine cannot build the graph or
+ * the graph fails to preroll; a failure after that is final.
+ */
+static gboolean
+check_media(MediaInfoCache *cache, const char *path, gboolean want_video)
+{
+  const MediaInfo *info = media_info_cache_lookup(cache, path);
+  GstElement *pipeline = NULL, *video_sink = NULL;
+  CheckResult result = CHECK_PREROLL_FAILED;
+  gboolean engine = FALSE;
+  gint frames = 0;
+
+  printf("%s\n", path);
+
+  if (info && ((want_video && info->is_image) || engine_can_play(info, want_video))) {
+    engine = TRUE;
+    video_sink = want_video ? fake_sink(&frames) : NULL;
+    if ((pipeline = engine_pipeline(info, want_video, video_sink)) != NULL)
+      result = check_pipeline(pipeline, video_sink, &frames);
+    if (CHECK_OK == result) {
+      printf("  status: ok\n");
+      return TRUE;
+    }
+    if (CHECK_DECODE_FAILED == result) {
+      printf("  status: unplayable, the engine failed after preroll\n");
+      return FALSE;
+    }
+  }
+
+  frames = 0;
+  video_sink = want_video ? fake_sink(&frames) : NULL;
+  if ((pipeline = playbin_pipeline(info, path, video_sink)) != NULL)
+    result = check_pipeline(pipeline, video_sink, &frames);
+  else
+    result = CHECK_PREROLL_FAILED;
+
+  if (CHECK_OK == result)
+    printf("  status: %s\n", engine ? "engine failed, playbin2 ok" : "ok");
+  else
+    printf("  status: unplayable\n");
+
+  return (CHECK_OK == result);
+}
+
+/*
+ * Check every logo in the playlist, every resolution variant included,
+ * printing a report to stdout, against the media cache in cache_file, or
+ * the system one if NULL. Requires GStreamer to be initialised. Returns
+ * FALSE if any file failed.
+ */
+gboolean
+check_run(Playlist *playlist, const char *cache_file)
+{
+  MediaInfoCache *cache = media_info_cache_load(cache_file);
+  const PlaylistEntry *entry = NULL;
+  guint Nix;
+  int Nix1, total = playlist_get_total_duration(playlist);
+  gboolean ret = TRUE;
+
+  for (Nix = 0 ; (entry = playlist_get_entry(playlist, Nix)) != NULL ; Nix++) {
+    printf("logo %u: duration %d ms\n", Nix + 1, entry->duration);
+    /* The files were looked for when the playlist was loaded */
+    if (entry->status != PLAYLIST_ENTRY_OK) {
+      printf("  %s%s%s%s\n",
+             (entry->status & PLAYLIST_ENTRY_EMPTY) ? "no media configured " : "",
+             (entry->status & PLAYLIST_ENTRY_MISSING_VIDEO) ? "video missing " : "",
+             (entry->status & PLAYLIST_ENTRY_MISSING_AUDIO) ? "sound missing " : "",
+             (entry->status & PLAYLIST_ENTRY_MISSING_VARIANT) ? "variants missing " : "");
+      ret = FALSE;
+    }
+    if (entry->video && entry->video[0] && !(entry->status & PLAYLIST_ENTRY_MISSING_VIDEO))
+      ret = check_media(cache, entry->video, TRUE) && ret;
+    for (Nix1 = 0 ; entry->variants && entry->variants[Nix1] && entry->variants[Nix1 + 1] ; Nix1 += 2) {
+      printf("variant %s: ", entry->variants[Nix1]);
+      ret = check_media(cache, entry->variants[Nix1 + 1], TRUE) && ret;
+    }
+    if (entry->audio && entry->audio[0] && !('s' == entry->audio[0] && 0 == entry->audio[1]) &&
+        !(entry->status & PLAYLIST_ENTRY_MISSING_AUDIO))
+      ret = check_media(cache, entry->audio, FALSE) && ret;
+  }
+
+  if (0 == playlist_get_length(playlist)) {
+    printf("No logos configured\n");
+    ret = FALSE;
+  }
+  else
+  if (total < 0)
+    printf("total: unknown, a logo runs for as long as its media\n");
+  else
+    printf("total: %d ms\n", total);
+
+  media_info_cache_free(cache);
+  return ret;
+}
@@ -21,120 +21,639 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include "conffile.h"
 
 #define FACTORY_CONF_FILE "default.conf"
+#define VARIANT_KEY_PREFIX "filename-"
 
-struct _ConfFileIterator
+/*
+ * The compiled playlist is a native-endian image of the configuration
+ * directory: a header, an array of fixed-size entries and a string area
+ * holding the resolved absolute paths. String offsets are relative to the
+ * start of the file, 0 meaning "no string". It is only valid as long as
+ * the directory's mtime matches the one recorded in the header. Entries are
+ * in playlist order. An entry's
+ * variants are a run of "WxH", path string pairs ended by an empty string.
+ */
+#define PLAYLIST_CACHE_MAGIC 0x4c504857 /* "WHPL" */
+#define PLAYLIST_CACHE_VERSION 3
+
+enum
+{
+  AUDIO_MODE_NONE = 0,
+  AUDIO_MODE_FILE,
+  AUDIO_MODE_SILENCE
+};
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  gint64 dir_mtime;
+  guint32 n_entries;
+  guint32 reserved;
+} PlaylistCacheHeader;
+
+typedef struct
+{
+  guint32 video;
+  guint32 audio;
+  gint32 duration;
+  guint32 audio_mode;
+  guint32 variants;
+} PlaylistCacheEntry;
+
+struct _Playlist
 {
   char *path;
-  gboolean new;
-  GDir *dir;
+  GPtrArray *entries;
+  char *resolution;
 };
 
-ConfFileIterator *
-conf_file_iterator_new()
+static gboolean
+dir_mtime(const char *path, gint64 *p_mtime)
 {
-  ConfFileIterator *itr = NULL;
+  struct stat st;
 
-  if ((itr = g_new(ConfFileIterator, 1))) {
-    itr->new = TRUE;
-    if ((itr->path = g_build_filename(SYSCONFDIR, PACKAGE_NAME ".d", NULL)) != NULL) {
-      if ((itr->dir = g_dir_open(itr->path, 0, NULL)) == NULL) {
-        g_free(itr->path);
-        g_free(itr);
-        itr = NULL;
-      }
-    }
-    else {
-      g_free(itr);
-      itr = NULL;
+  if (g_stat(path, &st) != 0)
+    return FALSE;
+
+  (*p_mtime) = (gint64)(st.st_mtime);
+  return TRUE;
+}
+
+static gboolean
+is_silence(const char *audio)
+{
+  return (audio && 's' == audio[0] && 0 == audio[1]);
+}
+
+static void
+playlist_entry_free(PlaylistEntry *entry)
+{
+  if (!entry) return;
+  g_free(entry->video);
+  g_free(entry->audio);
+  g_strfreev(entry->variants);
+  g_free(entry);
+}
+
+static const PlaylistCacheEntry *
+cache_entries(const char *cache)
+{
+  return (const PlaylistCacheEntry *)(cache + sizeof(PlaylistCacheHeader));
+}
+
+/* A string must start past the header and end in a NUL before the end of the file */
+static gboolean
+cache_string_valid(const char *cache, gsize size, guint32 offset)
+{
+  return (0 == offset ||
+    (offset >= sizeof(PlaylistCacheHeader) && offset < size &&
+     memchr(cache + offset, 0, size - offset) != NULL));
+}
+
+static char *
+cache_get_string(const char *cache, gsize size, guint32 offset)
+{
+  return (offset && cache_string_valid(cache, size, offset)) ? g_strdup(cache + offset) : NULL;
+}
+
+/* Each string of the run is checked, as is the empty string that ends it */
+static gboolean
+cache_get_variants(const char *cache, gsize size, guint32 offset, char ***p_variants)
+{
+  GPtrArray *variants = NULL;
+  guint32 pos;
+
+  (*p_variants) = NULL;
+  if (!offset)
+    return TRUE;
+
+  variants = g_ptr_array_new();
+  for (pos = offset ; ; pos += strlen(cache + pos) + 1) {
+    if (!cache_string_valid(cache, size, pos)) {
+      g_ptr_array_foreach(variants, (GFunc)g_free, NULL);
+      g_ptr_array_free(variants, TRUE);
+      return FALSE;
     }
+    if (!cache[pos])
+      break;
+    g_ptr_array_add(variants, g_strdup(cache + pos));
   }
+  /* Pairs only */
+  if (variants->len & 1)
+    g_free(g_ptr_array_remove_index(variants, variants->len - 1));
+  g_ptr_array_add(variants, NULL);
 
-  return itr;
+  (*p_variants) = (char **)g_ptr_array_free(variants, FALSE);
+  return TRUE;
 }
 
+/* Load the compiled playlist if it is intact and describes the current directory */
 static gboolean
-read_conf_file(char *conffile, char **p_video, char **p_audio, int *p_duration)
+playlist_load_cache(Playlist *playlist)
+{
+  const PlaylistCacheHeader *header = NULL;
+  const PlaylistCacheEntry *entries = NULL;
+  PlaylistEntry *entry = NULL;
+  struct stat st;
+  gint64 mtime = 0;
+  char *map = NULL;
+  gboolean ret = FALSE;
+  guint Nix;
+  int fd = -1;
+
+  if (!dir_mtime(playlist->path, &mtime))
+    return FALSE;
+
+  if ((fd = open(PLAYLIST_CACHE_FILE, O_RDONLY)) < 0)
+    return FALSE;
+
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PlaylistCacheHeader)) {
+    close(fd);
+    return FALSE;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == map)
+    return FALSE;
+
+  header = (const PlaylistCacheHeader *)map;
+  if (header->magic != PLAYLIST_CACHE_MAGIC ||
+      header->version != PLAYLIST_CACHE_VERSION ||
+      header->dir_mtime != mtime ||
+      /* Divided rather than multiplied, which could wrap on 32 bits */
+      header->n_entries > ((gsize)(st.st_size) - sizeof(PlaylistCacheHeader)) / sizeof(PlaylistCacheEntry)) {
+    g_debug("playlist_load_cache: %s is stale or invalid", PLAYLIST_CACHE_FILE);
+    munmap(map, st.st_size);
+    return FALSE;
+  }
+
+  entries = cache_entries(map);
+  for (Nix = 0 ; Nix < header->n_entries ; Nix++)
+    if (!(cache_string_valid(map, st.st_size, entries[Nix].video) &&
+          cache_string_valid(map, st.st_size, entries[Nix].audio))) {
+      g_debug("playlist_load_cache: %s has a bad entry", PLAYLIST_CACHE_FILE);
+      break;
+    }
+    else
+    if ((entry = g_new0(PlaylistEntry, 1)) != NULL) {
+      g_ptr_array_add(playlist->entries, entry);
+      entry->video = cache_get_string(map, st.st_size, entries[Nix].video);
+      if (AUDIO_MODE_SILENCE == entries[Nix].audio_mode)
+        entry->audio = g_strdup("s");
+      else
+        entry->audio = cache_get_string(map, st.st_size, entries[Nix].audio);
+      entry->duration = entries[Nix].duration;
+      if (!cache_get_variants(map, st.st_size, entries[Nix].variants, &(entry->variants))) {
+        g_debug("playlist_load_cache: %s has bad variants", PLAYLIST_CACHE_FILE);
+        break;
+      }
+    }
+
+  ret = (Nix == header->n_entries);
+  munmap(map, st.st_size);
+
+  /* A damaged file is dropped as a whole, and the directory parsed instead */
+  if (!ret) {
+    g_ptr_array_foreach(playlist->entries, (GFunc)playlist_entry_free, NULL);
+    g_ptr_array_set_size(playlist->entries, 0);
+  }
+
+  return ret;
+}
+
+/* Relative media file names are looked up in the media directory */
+static char *
+media_path(char *name)
 {
   char *str = NULL;
-  GKeyFile *file = NULL;
 
-  g_debug("read_conf_file(%s)", conffile);
-  if ((file = g_key_file_new())) {
-    if (g_key_file_load_from_file(file, conffile, G_KEY_FILE_NONE | G_KEY_FILE_KEEP_COMMENTS, NULL)) {
+  if (name && name[0] && name[0] != '/')
+    if ((str = g_build_filename(DATADIR, PACKAGE_NAME, "media", name, NULL)) != NULL) {
+      g_free(name);
+      name = str;
+    }
 
-      (*p_video) = g_key_file_get_string(file, PACKAGE_NAME, "filename", NULL);
-      if ((*p_video) && (*p_video)[0] && (*p_video)[0] != '/')
-        if ((str = g_build_filename(DATADIR, PACKAGE_NAME, "media", (*p_video), NULL)) != NULL) {
-          g_free((*p_video));
-          (*p_video) = str;
-        }
+  return name;
+}
+
+/* The "filename-WxH" keys, as a vector of "WxH", path pairs */
+static char **
+read_variants(GKeyFile *file)
+{
+  GPtrArray *variants = g_ptr_array_new();
+  char **keys = NULL, *value = NULL;
+  unsigned int width, height;
+  int Nix;
 
-      (*p_audio) = g_key_file_get_string(file, PACKAGE_NAME, "sound", NULL);
-      if ((*p_audio) && (*p_audio)[0] && !('s' == (*p_audio)[0] && 0 == (*p_audio)[1]) && (*p_audio)[0] != '/')
-        if ((str = g_build_filename(DATADIR, PACKAGE_NAME, "media", (*p_audio), NULL)) != NULL) {
-          g_free((*p_audio));
-          (*p_audio) = str;
+  if ((keys = g_key_file_get_keys(file, PACKAGE_NAME, NULL, NULL)) != NULL) {
+    for (Nix = 0 ; keys[Nix] ; Nix++)
+      if (g_str_has_prefix(keys[Nix], VARIANT_KEY_PREFIX) &&
+          2 == sscanf(keys[Nix] + strlen(VARIANT_KEY_PREFIX), "%ux%u", &width, &height))
+        if ((value = g_key_file_get_string(file, PACKAGE_NAME, keys[Nix], NULL)) != NULL) {
+          g_ptr_array_add(variants, g_strdup_printf("%ux%u", width, height));
+          g_ptr_array_add(variants, media_path(value));
         }
+    g_strfreev(keys);
+  }
 
-      (*p_duration) = g_key_file_get_integer(file, PACKAGE_NAME, "duration", NULL);
+  if (0 == variants->len) {
+    g_ptr_array_free(variants, TRUE);
+    return NULL;
+  }
 
-      return TRUE;
-    }
+  g_ptr_array_add(variants, NULL);
+  return (char **)g_ptr_array_free(variants, FALSE);
+}
+
+static PlaylistEntry *
+read_conf_file(const char *dir, const char *fname)
+{
+  PlaylistEntry *entry = NULL;
+  GKeyFile *file = NULL;
+  char *conffile = NULL;
+
+  if ((conffile = g_build_filename(dir, fname, NULL)) == NULL)
+    return NULL;
+
+  g_debug("read_conf_file(%s)", conffile);
+  if ((file = g_key_file_new())) {
+    if (g_key_file_load_from_file(file, conffile, G_KEY_FILE_NONE | G_KEY_FILE_KEEP_COMMENTS, NULL))
+      if ((entry = g_new0(PlaylistEntry, 1)) != NULL) {
+        entry->video = media_path(g_key_file_get_string(file, PACKAGE_NAME, "filename", NULL));
+        entry->variants = read_variants(file);
+
+        entry->audio = g_key_file_get_string(file, PACKAGE_NAME, "sound", NULL);
+        if (!is_silence(entry->audio))
+          entry->audio = media_path(entry->audio);
+
+        entry->duration = g_key_file_get_integer(file, PACKAGE_NAME, "duration", NULL);
+      }
     g_key_file_free(file);
   }
+  g_free(conffile);
 
-  return FALSE;
+  return entry;
 }
 
-gboolean
-conf_file_iterator_get(ConfFileIterator *itr, char **p_video, char **p_audio, int *p_duration)
+static gint
+compare_names(gconstpointer a, gconstpointer b)
 {
-  gboolean read_success = FALSE;
+  return strcmp(*((const char **)a), *((const char **)b));
+}
+
+/* default.conf comes first, the other files follow in the order of their names */
+static gboolean
+playlist_load_dir(Playlist *playlist)
+{
+  PlaylistEntry *entry = NULL;
+  GPtrArray *names = NULL;
   const char *fname;
-  char *conffile;
+  GDir *dir = NULL;
+  guint Nix;
+
+  if ((dir = g_dir_open(playlist->path, 0, NULL)) == NULL)
+    return FALSE;
 
-  if (!(p_video && p_audio && p_duration)) return FALSE;
+  names = g_ptr_array_new();
+  while ((fname = g_dir_read_name(dir)) != NULL)
+    if (strcmp(fname, FACTORY_CONF_FILE))
+      g_ptr_array_add(names, g_strdup(fname));
+  g_dir_close(dir);
+  g_ptr_array_sort(names, compare_names);
+
+  if ((entry = read_conf_file(playlist->path, FACTORY_CONF_FILE)) != NULL)
+    g_ptr_array_add(playlist->entries, entry);
 
-  (*p_video) = NULL;
-  (*p_audio) = NULL;
-  (*p_duration) = 0;
+  for (Nix = 0 ; Nix < names->len ; Nix++) {
+    if ((entry = read_conf_file(playlist->path, g_ptr_array_index(names, Nix))) != NULL)
+      g_ptr_array_add(playlist->entries, entry);
+    g_free(g_ptr_array_index(names, Nix));
+  }
+  g_ptr_array_free(names, TRUE);
 
-  /* Special case: read default.conf file */
-  if (itr->new) {
-    if ((conffile = g_build_filename(itr->path, FACTORY_CONF_FILE, NULL)) != NULL) {
-      read_success = read_conf_file(conffile, p_video, p_audio, p_duration);
-      g_free(conffile);
+  return TRUE;
+}
+
+static gboolean
+media_exists(const char *path)
+{
+  return g_file_test(path, G_FILE_TEST_IS_REGULAR);
+}
+
+/*
+ * Look for every media file of every entry in one go, so that the player
+ * knows what it can play before it starts. Missing variants are dropped.
+ */
+static void
+playlist_validate(Playlist *playlist)
+{
+  PlaylistEntry *entry = NULL;
+  GPtrArray *variants = NULL;
+  guint Nix;
+  int Nix1;
+
+  for (Nix = 0 ; Nix < playlist->entries->len ; Nix++) {
+    entry = g_ptr_array_index(playlist->entries, Nix);
+    entry->status = PLAYLIST_ENTRY_OK;
+
+    if (!(entry->video && entry->video[0]) && !(entry->audio && entry->audio[0]))
+      entry->status |= PLAYLIST_ENTRY_EMPTY;
+    if (entry->video && entry->video[0] && !media_exists(entry->video))
+      entry->status |= PLAYLIST_ENTRY_MISSING_VIDEO;
+    if (entry->audio && entry->audio[0] && !is_silence(entry->audio) && !media_exists(entry->audio))
+      entry->status |= PLAYLIST_ENTRY_MISSING_AUDIO;
+
+    if (entry->variants) {
+      variants = g_ptr_array_new();
+      for (Nix1 = 0 ; entry->variants[Nix1] && entry->variants[Nix1 + 1] ; Nix1 += 2)
+        if (media_exists(entry->variants[Nix1 + 1])) {
+          g_ptr_array_add(variants, entry->variants[Nix1]);
+          g_ptr_array_add(variants, entry->variants[Nix1 + 1]);
+        }
+        else {
+          g_warning("playlist_validate: The %s variant %s does not exist\n", entry->variants[Nix1], entry->variants[Nix1 + 1]);
+          entry->status |= PLAYLIST_ENTRY_MISSING_VARIANT;
+          g_free(entry->variants[Nix1]);
+          g_free(entry->variants[Nix1 + 1]);
+        }
+      /* A dangling odd string */
+      if (entry->variants[Nix1])
+        g_free(entry->variants[Nix1]);
+      g_free(entry->variants);
+      if (variants->len > 0) {
+        g_ptr_array_add(variants, NULL);
+        entry->variants = (char **)g_ptr_array_free(variants, FALSE);
+      }
+      else {
+        g_ptr_array_free(variants, TRUE);
+        entry->variants = NULL;
+      }
     }
-    itr->new = FALSE;
+
+    if (entry->status & PLAYLIST_ENTRY_MISSING_VIDEO)
+      g_warning("playlist_validate: %s does not exist\n", entry->video);
+    if (entry->status & PLAYLIST_ENTRY_MISSING_AUDIO)
+      g_warning("playlist_validate: %s does not exist\n", entry->audio);
   }
+}
 
-  while (!read_success && (fname = g_dir_read_name(itr->dir)))
-    if (strcmp(fname, FACTORY_CONF_FILE))
-      if ((conffile = g_build_filename(itr->path, fname, NULL)) != NULL) {
-        read_success = read_conf_file(conffile, p_video, p_audio, p_duration);
-        g_free(conffile);
+static Playlist *
+playlist_new_real(const char *path, gboolean use_cache)
+{
+  Playlist *playlist = NULL;
+
+  if ((playlist = g_new0(Playlist, 1))) {
+    playlist->entries = g_ptr_array_new();
+    if ((playlist->path = (path ? g_strdup(path) : g_build_filename(SYSCONFDIR, PACKAGE_NAME ".d", NULL))) != NULL) {
+      if (use_cache && playlist_load_cache(playlist))
+        g_debug("playlist_new: Using compiled playlist %s", PLAYLIST_CACHE_FILE);
+      else
+      if (!playlist_load_dir(playlist)) {
+        playlist_free(playlist);
+        playlist = NULL;
+      }
+    }
+    else {
+      playlist_free(playlist);
+      playlist = NULL;
+    }
+  }
+
+  return playlist;
+}
+
+/* Load the system configuration, from the compiled playlist where it is current */
+Playlist *
+playlist_new()
+{
+  Playlist *playlist = NULL;
+
+  if ((playlist = playlist_new_real(NULL, TRUE)) != NULL)
+    playlist_validate(playlist);
+
+  return playlist;
+}
+
+/* Load the .conf files in another directory. The compiled playlist is not used. */
+Playlist *
+playlist_new_for_path(const char *path)
+{
+  Playlist *playlist = NULL;
+
+  if ((playlist = playlist_new_real(path, FALSE)) != NULL)
+    playlist_validate(playlist);
+
+  return playlist;
+}
+
+guint
+playlist_get_length(Playlist *playlist)
+{
+  return playlist->entries->len;
+}
+
+/* NULL past the end */
+const PlaylistEntry *
+playlist_get_entry(Playlist *playlist, guint index)
+{
+  if (index >= playlist->entries->len)
+    return NULL;
+
+  return g_ptr_array_index(playlist->entries, index);
+}
+
+/*
+ * The video to play for an entry: the variant for the resolution given to
+ * playlist_set_resolution() where the entry has one, or else its "filename".
+ */
+const char *
+playlist_get_video(Playlist *playlist, guint index)
+{
+  const PlaylistEntry *entry = NULL;
+  int Nix;
+
+  if ((entry = playlist_get_entry(playlist, index)) == NULL)
+    return NULL;
+
+  if (entry->variants && playlist->resolution)
+    for (Nix = 0 ; entry->variants[Nix] && entry->variants[Nix + 1] ; Nix += 2)
+      if (g_str_equal(entry->variants[Nix], playlist->resolution)) {
+        g_debug("playlist_get_video: Using the %s variant %s", playlist->resolution, entry->variants[Nix + 1]);
+        return entry->variants[Nix + 1];
       }
 
-  if (!read_success) {
-    g_free((*p_video)); (*p_video) = NULL;
-    g_free((*p_audio)); (*p_audio) = NULL;
-    (*p_duration) = 0;
+  return entry->video;
+}
+
+/*
+ * The sum of the configured durations in milliseconds, or -1 if an entry
+ * that can be played runs for as long as its media does.
+ */
+int
+playlist_get_total_duration(Playlist *playlist)
+{
+  const PlaylistEntry *entry = NULL;
+  int total = 0;
+  guint Nix;
+
+  for (Nix = 0 ; Nix < playlist->entries->len ; Nix++) {
+    entry = g_ptr_array_index(playlist->entries, Nix);
+    if (!PLAYLIST_ENTRY_PLAYABLE(entry))
+      continue;
+    if (entry->duration <= 0)
+      return -1;
+    total += entry->duration;
   }
 
-  return read_success;
+  return total;
 }
 
+/* Prefer the videos encoded for this resolution, where the configuration has them */
 void
-conf_file_iterator_destroy(ConfFileIterator *itr)
+playlist_set_resolution(Playlist *playlist, int width, int height)
 {
-  if (!itr) return;
-  g_dir_close(itr->dir);
-  g_free(itr->path);
-  g_free(itr);
+  g_free(playlist->resolution);
+  playlist->resolution = g_strdup_printf("%ux%u", width, height);
+}
+
+void
+playlist_free(Playlist *playlist)
+{
+  if (!playlist) return;
+  g_ptr_array_foreach(playlist->entries, (GFunc)playlist_entry_free, NULL);
+  g_ptr_array_free(playlist->entries, TRUE);
+  g_free(playlist->path);
+  g_free(playlist->resolution);
+  g_free(playlist);
+}
+
+static guint32
+cache_add_string(GString *strings, const char *str)
+{
+  guint32 offset = 0;
+
+  if (str) {
+    offset = sizeof(PlaylistCacheHeader) + strings->len;
+    g_string_append_len(strings, str, strlen(str) + 1);
+  }
+
+  return offset;
+}
+
+static guint32
+cache_add_variants(GString *strings, char **variants)
+{
+  guint32 offset = 0;
+  int Nix;
+
+  if (variants && variants[0]) {
+    offset = sizeof(PlaylistCacheHeader) + strings->len;
+    for (Nix = 0 ; variants[Nix] ; Nix++)
+      g_string_append_len(strings, variants[Nix], strlen(variants[Nix]) + 1);
+    g_string_append_c(strings, 0);
+  }
+
+  return offset;
+}
+
+/*
+ * Parse the configuration directory and write it out as a compiled
+ * playlist, to be picked up by playlist_new() at boot.
+ */
+gboolean
+conf_file_cache_update()
+{
+  Playlist *playlist = NULL;
+  const PlaylistEntry *source = NULL;
+  PlaylistCacheHeader header = { 0, };
+  GArray *entries = NULL;
+  GString *strings = NULL, *image = NULL;
+  char *dir = NULL;
+  gboolean ret = FALSE;
+  guint Nix;
+
+  /* Take the mtime before parsing, so that a concurrent change invalidates the result */
+  dir = g_build_filename(SYSCONFDIR, PACKAGE_NAME ".d", NULL);
+  if (!dir_mtime(dir, &(header.dir_mtime))) {
+    g_warning("conf_file_cache_update: Cannot stat %s\n", dir);
+    g_free(dir);
+    return FALSE;
+  }
+
+  /* Not validated: media may be deployed after the configuration */
+  playlist = playlist_new_real(dir, FALSE);
+  g_free(dir);
+  if (playlist == NULL) {
+    g_warning("conf_file_cache_update: Cannot open configuration directory\n");
+    return FALSE;
+  }
+
+  entries = g_array_new(FALSE, TRUE, sizeof(PlaylistCacheEntry));
+  strings = g_string_new("");
+
+  for (Nix = 0 ; (source = playlist_get_entry(playlist, Nix)) != NULL ; Nix++) {
+    PlaylistCacheEntry entry = { 0, };
+
+    entry.video = cache_add_string(strings, source->video);
+    entry.variants = cache_add_variants(strings, source->variants);
+    if (is_silence(source->audio))
+      entry.audio_mode = AUDIO_MODE_SILENCE;
+    else
+    if (source->audio && source->audio[0]) {
+      entry.audio_mode = AUDIO_MODE_FILE;
+      entry.audio = cache_add_string(strings, source->audio);
+    }
+    entry.duration = source->duration;
+    g_array_append_val(entries, entry);
+  }
+  playlist_free(playlist);
+
+  header.magic = PLAYLIST_CACHE_MAGIC;
+  header.version = PLAYLIST_CACHE_VERSION;
+  header.n_entries = entries->len;
+
+  /* String offsets were computed as if the strings directly followed the header */
+  for (Nix = 0 ; Nix < entries->len ; Nix++) {
+    PlaylistCacheEntry *entry = &g_array_index(entries, PlaylistCacheEntry, Nix);
+    if (entry->video)
+      entry->video += entries->len * sizeof(PlaylistCacheEntry);
+    if (entry->audio)
+      entry->audio += entries->len * sizeof(PlaylistCacheEntry);
+    if (entry->variants)
+      entry->variants += entries->len * sizeof(PlaylistCacheEntry);
+  }
+
+  /* playlist_load_cache() checks every string against the size of the file */
+  image = g_string_sized_new(sizeof(header) + entries->len * sizeof(PlaylistCacheEntry) + strings->len);
+  g_string_append_len(image, (const char *)&header, sizeof(header));
+  g_string_append_len(image, entries->data, entries->len * sizeof(PlaylistCacheEntry));
+  g_string_append_len(image, strings->str, strings->len);
+
+  dir = g_path_get_dirname(PLAYLIST_CACHE_FILE);
+  if (g_mkdir_with_parents(dir, 0755) == 0 &&
+      g_file_set_contents(PLAYLIST_CACHE_FILE, image->str, image->len, NULL)) {
+    g_debug("conf_file_cache_update: Wrote %d entries to %s", entries->len, PLAYLIST_CACHE_FILE);
+    ret = TRUE;
+  }
+  else
+    g_warning("conf_file_cache_update: Failed to write %s\n", PLAYLIST_CACHE_FILE);
+
+  g_free(dir);
+  g_string_free(image, TRUE);
+  g_string_free(strings, TRUE);
+  g_array_free(entries, TRUE);
+
+  return ret;
 }
@@ -28,11 +28,43 @@
 
 G_BEGIN_DECLS
 
-typedef struct _ConfFileIterator ConfFileIterator;
+#define PLAYLIST_CACHE_FILE LOCALSTATEDIR "/cache/" PACKAGE_NAME "/playlist.cache"
 
-ConfFileIterator *conf_file_iterator_new();
-gboolean conf_file_iterator_get(ConfFileIterator *itr, char **p_video, char **p_audio, int *p_duration);
-void conf_file_iterator_destroy(ConfFileIterator *itr);
+/* What playlist_new() found out about the media of an entry */
+typedef enum
+{
+  PLAYLIST_ENTRY_OK = 0,
+  PLAYLIST_ENTRY_EMPTY = 1 << 0,            /* Neither a video nor a sound */
+  PLAYLIST_ENTRY_MISSING_VIDEO = 1 << 1,
+  PLAYLIST_ENTRY_MISSING_AUDIO = 1 << 2,
+  PLAYLIST_ENTRY_MISSING_VARIANT = 1 << 3   /* Dropped from the variants */
+} PlaylistEntryStatus;
+
+/* Without its sound, an entry can still show its video */
+#define PLAYLIST_ENTRY_PLAYABLE(entry)                                        \
+  (!((entry)->status & (PLAYLIST_ENTRY_EMPTY | PLAYLIST_ENTRY_MISSING_VIDEO)) && \
+   (((entry)->video && (entry)->video[0]) || !((entry)->status & PLAYLIST_ENTRY_MISSING_AUDIO)))
+
+typedef struct
+{
+  char *video;      /* As configured by "filename", or NULL */
+  char *audio;      /* A path, "s" for silence, or NULL */
+  int duration;     /* Milliseconds, 0 for as long as the media runs */
+  char **variants;  /* NULL-terminated "WxH", path pairs, or NULL */
+  PlaylistEntryStatus status;
+} PlaylistEntry;
+
+typedef struct _Playlist Playlist;
+
+Playlist *playlist_new();
+Playlist *playlist_new_for_path(const char *path);
+guint playlist_get_length(Playlist *playlist);
+const PlaylistEntry *playlist_get_entry(Playlist *playlist, guint index);
+const char *playlist_get_video(Playlist *playlist, guint index);
+int playlist_get_total_duration(Playlist *playlist);
+void playlist_set_resolution(Playlist *playlist, int width, int height);
+void playlist_free(Playlist *playlist);
+gboolean conf_file_cache_update();
 
 G_END_DECLS
 
@@ -0,0 +1,280 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <glib.h>
+#include "control.h"
+
+/*
+ * A Unix socket in the main loop, taking one command per connection: the
+ * client writes a line, gets a line back and the connection is closed.
+ * The socket lives in a directory of its own, named after the user, which
+ * only that user may enter: clients must run as the same user as the
+ * animation, as the session's do. Nothing is written with write(), so that a client
+ * that hangs up early cannot raise SIGPIPE.
+ */
+
+#define CONTROL_BACKLOG 4
+#define CONTROL_REPLY_CHUNK 256
+
+struct _Control
+{
+  char *path;
+  dev_t dev;
+  ino_t ino;
+  GIOChannel *channel;
+  guint watch_id;
+  GSList *clients;
+  ControlHandler handler;
+  gpointer user_data;
+};
+
+typedef struct
+{
+  Control *control;
+  GIOChannel *channel;
+  guint watch_id;
+} ControlClient;
+
+static void
+control_client_free(ControlClient *client)
+{
+  client->control->clients = g_slist_remove(client->control->clients, client);
+  if (client->watch_id)
+    g_source_remove(client->watch_id);
+  g_io_channel_shutdown(client->channel, FALSE, NULL);
+  g_io_channel_unref(client->channel);
+  g_free(client);
+}
+
+/* The whole of buf, or as much as a non-blocking socket takes */
+static void
+control_send_all(int fd, const char *buf, gsize length)
+{
+  ssize_t n = 0;
+
+  while (length > 0) {
+    if ((n = send(fd, buf, length, MSG_NOSIGNAL)) < 0) {
+      if (EINTR == errno)
+        continue;
+      g_debug("control_send_all: %s", g_strerror(errno));
+      return;
+    }
+    buf += n;
+    length -= n;
+  }
+}
+
+static gboolean
+control_client_cb(GIOChannel *channel, GIOCondition condition, ControlClient *client)
+{
+  char *line = NULL, *reply = NULL;
+  gsize length = 0;
+  GIOStatus status;
+
+  status = g_io_channel_read_line(channel, &line, &length, NULL, NULL);
+
+  /* Wait for the rest of the line */
+  if (G_IO_STATUS_AGAIN == status && !(condition & (G_IO_HUP | G_IO_ERR)))
+    return TRUE;
+
+  if (line) {
+    g_strstrip(line);
+    g_debug("control_client_cb: Command '%s'", line);
+    if ((reply = client->control->handler(line, client->control->user_data)) != NULL) {
+      control_send_all(g_io_channel_unix_get_fd(channel), reply, strlen(reply));
+      control_send_all(g_io_channel_unix_get_fd(channel), "\n", 1);
+      g_free(reply);
+    }
+    g_free(line);
+  }
+
+  /* Returning FALSE removes the watch */
+  client->watch_id = 0;
+  control_client_free(client);
+  return FALSE;
+}
+
+static gboolean
+control_accept_cb(GIOChannel *channel, GIOCondition condition, Control *control)
+{
+  ControlClient *client = NULL;
+  int fd = -1;
+
+  if ((fd = accept(g_io_channel_unix_get_fd(channel), NULL, NULL)) < 0)
+    return TRUE;
+
+  client = g_new0(ControlClient, 1);
+  client->control = control;
+  client->channel = g_io_channel_unix_new(fd);
+  g_io_channel_set_close_on_unref(client->channel, TRUE);
+  g_io_channel_set_encoding(client->channel, NULL, NULL);
+  g_io_channel_set_flags(client->channel, G_IO_FLAG_NONBLOCK, NULL);
+  client->watch_id = g_io_add_watch(client->channel, G_IO_IN | G_IO_HUP | G_IO_ERR, (GIOFunc)control_client_cb, client);
+  control->clients = g_slist_prepend(control->clients, client);
+
+  return TRUE;
+}
+
+static gboolean
+control_address(const char *path, struct sockaddr_un *addr)
+{
+  if (strlen(path) >= sizeof(addr->sun_path))
+    return FALSE;
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  strcpy(addr->sun_path, path);
+  return TRUE;
+}
+
+/* The directory holding the socket must be ours alone, or nothing in it can be trusted */
+static gboolean
+control_dir_ok(const char *path)
+{
+  char *dir = g_path_get_dirname(path);
+  struct stat st;
+  gboolean ret = FALSE;
+
+  if (g_mkdir_with_parents(dir, 0700) != 0 || lstat(dir, &st) != 0)
+    g_warning("control_dir_ok: Cannot create %s\n", dir);
+  else
+  if (!S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO)))
+    g_warning("control_dir_ok: %s is not a private directory\n", dir);
+  else
+    ret = TRUE;
+
+  g_free(dir);
+  return ret;
+}
+
+/* The socket of an instance running as the calling user */
+char *
+control_default_path()
+{
+  return g_strdup_printf(CONTROL_SOCKET_FORMAT, (guint)geteuid());
+}
+
+/* Listen for commands on path, handing them to handler from the main loop */
+Control *
+control_new(const char *path, ControlHandler handler, gpointer user_data)
+{
+  Control *control = NULL;
+  struct sockaddr_un addr;
+  struct stat st;
+  mode_t old_mask;
+  gboolean bound = FALSE;
+  int fd = -1;
+
+  if (!control_address(path, &addr)) {
+    g_warning("control_new: %s is too long for a socket path\n", path);
+    return NULL;
+  }
+  if (!control_dir_ok(path))
+    return NULL;
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    g_warning("control_new: Failed to create socket\n");
+    return NULL;
+  }
+
+  /* A socket left behind by an earlier instance would be in the way */
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+  /* Created 0600, so that it is never reachable by others, not even briefly */
+  old_mask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+  bound = (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+  umask(old_mask);
+  if (!bound || listen(fd, CONTROL_BACKLOG) != 0 || lstat(path, &st) != 0) {
+    g_warning("control_new: Failed to listen on %s\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  control = g_new0(Control, 1);
+  control->path = g_strdup(path);
+  control->dev = st.st_dev;
+  control->ino = st.st_ino;
+  control->handler = handler;
+  control->user_data = user_data;
+  control->channel = g_io_channel_unix_new(fd);
+  g_io_channel_set_close_on_unref(control->channel, TRUE);
+  control->watch_id = g_io_add_watch(control->channel, G_IO_IN, (GIOFunc)control_accept_cb, control);
+
+  return control;
+}
+
+void
+control_free(Control *control)
+{
+  struct stat st;
+
+  if (!control) return;
+
+  while (control->clients)
+    control_client_free(control->clients->data);
+  g_source_remove(control->watch_id);
+  g_io_channel_unref(control->channel);
+  /* Only the socket this instance created */
+  if (lstat(control->path, &st) == 0 && st.st_dev == control->dev && st.st_ino == control->ino)
+    unlink(control->path);
+  g_free(control->path);
+  g_free(control);
+}
+
+/* Send command to the instance listening on path and return its reply */
+gboolean
+control_send(const char *path, const char *command, char **p_reply)
+{
+  struct sockaddr_un addr;
+  GString *reply = NULL;
+  char buf[CONTROL_REPLY_CHUNK];
+  ssize_t n = 0;
+  int fd = -1;
+
+  if (!control_address(path, &addr))
+    return FALSE;
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return FALSE;
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      send(fd, command, strlen(command), MSG_NOSIGNAL) < 0 ||
+      send(fd, "\n", 1, MSG_NOSIGNAL) < 0) {
+    close(fd);
+    return FALSE;
+  }
+
+  reply = g_string_new("");
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    g_string_append_len(reply, buf, n);
+  close(fd);
+
+  (*p_reply) = g_strchomp(g_string_free(reply, FALSE));
+  return TRUE;
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _CONTROL_H_
+#define _CONTROL_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Per user, as /var/run only takes directories from root and the session is not root */
+#define CONTROL_SOCKET_FORMAT "/tmp/" PACKAGE_NAME "-%u/control"
+
+/* Returns the newly allocated reply to a command */
+typedef char *(*ControlHandler)(const char *command, gpointer user_data);
+
+typedef struct _Control Control;
+
+char *control_default_path();
+Control *control_new(const char *path, ControlHandler handler, gpointer user_data);
+void control_free(Control *control);
+gboolean control_send(const char *path, const char *command, char **p_reply);
+
+G_END_DECLS
+
+#endif /* !_CONTROL_H_ */
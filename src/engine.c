@@ -0,0 +1,334 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <gst/gst.h>
+#include "mediainfo.h"
+#include "engine.h"
+
+/*
+ * Builds the decoding graph for a media file element by element, from what
+ * the media cache knows about it: filesrc ! demuxer, and for each wanted
+ * stream queue ! [parser] ! decoder ! converters ! sink, linked when the
+ * demuxer exposes the stream's pad. No typefinding or autoplugging takes
+ * place. The parsers are the ones decodebin2 inserted when the file was
+ * probed, after the demuxer or without one. Still images are decoded once,
+ * as the pipeline prerolls.
+ */
+
+typedef struct
+{
+  char *video_caps;
+  char *audio_caps;
+  GstElement *video_queue;
+  GstElement *audio_queue;
+} DemuxLinks;
+
+static void
+demux_links_free(DemuxLinks *links)
+{
+  g_free(links->video_caps);
+  g_free(links->audio_caps);
+  g_free(links);
+}
+
+static gboolean
+pad_has_media_type(GstPad *pad, const char *media_type)
+{
+  GstCaps *caps = NULL;
+  gboolean ret = FALSE;
+
+  if (!media_type) return FALSE;
+
+  if ((caps = gst_pad_get_caps(pad)) != NULL) {
+    if (gst_caps_get_size(caps) > 0)
+      ret = g_str_equal(gst_structure_get_name(gst_caps_get_structure(caps, 0)), media_type);
+    gst_caps_unref(caps);
+  }
+
+  return ret;
+}
+
+static void
+link_pad_to(GstPad *pad, GstElement *element)
+{
+  GstPad *sink_pad = NULL;
+
+  if ((sink_pad = gst_element_get_static_pad(element, "sink")) != NULL) {
+    if (!gst_pad_is_linked(sink_pad))
+      if (GST_PAD_LINK_OK != gst_pad_link(pad, sink_pad))
+        g_warning("link_pad_to: Failed to link %s:%s\n", GST_DEBUG_PAD_NAME(pad));
+    gst_object_unref(sink_pad);
+  }
+}
+
+/* Runs in the demuxer's streaming thread. Other streams stay unlinked. */
+static void
+demux_pad_added(GstElement *demuxer, GstPad *pad, DemuxLinks *links)
+{
+  if (links->video_queue && pad_has_media_type(pad, links->video_caps))
+    link_pad_to(pad, links->video_queue);
+  else
+  if (links->audio_queue && pad_has_media_type(pad, links->audio_caps))
+    link_pad_to(pad, links->audio_queue);
+}
+
+/* Create, add and link a chain of elements. Returns its first element. */
+static GstElement *
+add_chain(GstBin *bin, GstElement **elements, int n_elements)
+{
+  int Nix;
+
+  for (Nix = 0 ; Nix < n_elements ; Nix++)
+    if (!elements[Nix]) {
+      for (Nix = 0 ; Nix < n_elements ; Nix++)
+        if (elements[Nix] && !GST_OBJECT_PARENT(elements[Nix]))
+          gst_object_unref(gst_object_ref_sink(elements[Nix]));
+      return NULL;
+    }
+
+  for (Nix = 0 ; Nix < n_elements ; Nix++)
+    gst_bin_add(bin, elements[Nix]);
+
+  for (Nix = 1 ; Nix < n_elements ; Nix++)
+    if (!gst_element_link(elements[Nix - 1], elements[Nix])) {
+      g_warning("add_chain: Failed to link %s to %s\n", GST_ELEMENT_NAME(elements[Nix - 1]), GST_ELEMENT_NAME(elements[Nix]));
+      return NULL;
+    }
+
+  return elements[0];
+}
+
+static GstElement *
+add_video_branch(GstBin *bin, const MediaInfo *info, GstElement *sink)
+{
+  GstElement *elements[6];
+  int n = 0;
+
+  elements[n++] = gst_element_factory_make("queue", NULL);
+  if (info->video_parser)
+    elements[n++] = gst_element_factory_make(info->video_parser, NULL);
+  elements[n++] = gst_element_factory_make(info->video_decoder, NULL);
+  /* Both pass buffers through untouched when the sink takes the decoder's output */
+  elements[n++] = gst_element_factory_make("ffmpegcolorspace", NULL);
+  elements[n++] = gst_element_factory_make("videoscale", NULL);
+  elements[n++] = sink;
+
+  return add_chain(bin, elements, n);
+}
+
+static GstElement *
+add_audio_branch(GstBin *bin, const MediaInfo *info, GstElement *sink)
+{
+  GstElement *elements[6];
+  int n = 0;
+
+  elements[n++] = gst_element_factory_make("queue", NULL);
+  if (info->audio_parser)
+    elements[n++] = gst_element_factory_make(info->audio_parser, NULL);
+  elements[n++] = gst_element_factory_make(info->audio_decoder, NULL);
+  elements[n++] = gst_element_factory_make("audioconvert", NULL);
+  elements[n++] = gst_element_factory_make("audioresample", NULL);
+  elements[n++] = sink;
+
+  return add_chain(bin, elements, n);
+}
+
+/*
+ * Have filesrc hand out buffers that point into the mapped file instead of
+ * read() copies, so demuxers and decoders work on the page cache itself.
+ */
+void
+engine_source_use_mmap(GstElement *src)
+{
+  if (g_object_class_find_property(G_OBJECT_GET_CLASS(src), "use-mmap"))
+    g_object_set(G_OBJECT(src), "use-mmap", TRUE, NULL);
+}
+
+/* Whether the media cache knows enough about the file for engine_file_bin_new() */
+gboolean
+engine_can_play(const MediaInfo *info, gboolean want_video)
+{
+  if (!info || info->is_image)
+    return FALSE;
+
+  if (want_video)
+    return (info->video_decoder && (info->video_caps || !(info->demuxer)));
+  else
+    return (info->audio_decoder && (info->audio_caps || !(info->demuxer)));
+}
+
+static gboolean
+add_file(GstBin *bin, const MediaInfo *info, GstElement *video_sink, GstElement *audio_sink)
+{
+  GstElement *src = NULL, *demuxer = NULL, *video_branch = NULL, *audio_branch = NULL;
+  DemuxLinks *links = NULL;
+
+  if (video_sink)
+    if ((video_branch = add_video_branch(bin, info, video_sink)) == NULL)
+      return FALSE;
+
+  if (audio_sink && info->audio_decoder && (info->audio_caps || (!(info->demuxer) && !video_sink)))
+    if ((audio_branch = add_audio_branch(bin, info, audio_sink)) == NULL)
+      return FALSE;
+
+  if (!(video_branch || audio_branch))
+    return FALSE;
+
+  if ((src = gst_element_factory_make("filesrc", NULL)) == NULL)
+    return FALSE;
+  g_object_set(G_OBJECT(src), "location", info->path, NULL);
+  engine_source_use_mmap(src);
+  gst_bin_add(bin, src);
+
+  if (!(info->demuxer))
+    return gst_element_link(src, video_branch ? video_branch : audio_branch);
+
+  if ((demuxer = gst_element_factory_make(info->demuxer, NULL)) == NULL)
+    return FALSE;
+  gst_bin_add(bin, demuxer);
+  if (!gst_element_link(src, demuxer))
+    return FALSE;
+
+  links = g_new0(DemuxLinks, 1);
+  links->video_caps = g_strdup(info->video_caps);
+  links->audio_caps = g_strdup(info->audio_caps);
+  links->video_queue = video_branch;
+  links->audio_queue = audio_branch;
+  g_signal_connect_data(G_OBJECT(demuxer), "pad-added", (GCallback)demux_pad_added, links, (GClosureNotify)demux_links_free, 0);
+
+  return TRUE;
+}
+
+/*
+ * A bin playing the file: the video stream goes to video_sink and the audio
+ * stream to audio_sink. Without an audio_sink the audio stream is not
+ * decoded; without a video_sink the audio stream is played on its own. The
+ * bin takes the sinks over, and drops those it has no use for. Returns NULL
+ * if the graph could not be built.
+ */
+GstElement *
+engine_file_bin_new(const MediaInfo *info, GstElement *video_sink, GstElement *audio_sink)
+{
+  GstElement *bin = NULL;
+
+  /* Ours until the bin takes them, whatever happens */
+  if (video_sink)
+    gst_object_ref_sink(video_sink);
+  if (audio_sink)
+    gst_object_ref_sink(audio_sink);
+
+  if (engine_can_play(info, video_sink != NULL))
+    if ((bin = gst_bin_new(NULL)) != NULL)
+      if (!add_file(GST_BIN(bin), info, video_sink, audio_sink)) {
+        g_warning("engine_file_bin_new: Failed to build the graph for %s\n", info->path);
+        gst_object_unref(bin);
+        bin = NULL;
+      }
+
+  if (video_sink)
+    gst_object_unref(video_sink);
+  if (audio_sink)
+    gst_object_unref(audio_sink);
+
+  return bin;
+}
+
+/* Runs in the streaming thread: keep the one frame up until the logo is stopped */
+static gboolean
+drop_eos(GstPad *pad, GstEvent *event, gpointer null)
+{
+  return (GST_EVENT_EOS != GST_EVENT_TYPE(event));
+}
+
+/*
+ * A bin showing a still image on video_sink, which the bin takes over. The
+ * image is decoded, converted and scaled once, in the streaming thread as
+ * the pipeline prerolls, and nothing runs per frame after that. With a
+ * duration_ms, EOS is held back, so the sink keeps the frame until the
+ * logo is stopped; without one, the logo ends with the image.
+ */
+GstElement *
+engine_still_bin_new(const MediaInfo *info, GstElement *video_sink, int duration_ms)
+{
+  GstElement *bin = NULL, *elements[6];
+  GstPad *pad = NULL;
+  int n = 0;
+
+  if (!(info && info->is_image && info->video_decoder && video_sink))
+    return NULL;
+
+  gst_object_ref_sink(video_sink);
+
+  elements[n++] = gst_element_factory_make("filesrc", NULL);
+  if (info->video_parser)
+    elements[n++] = gst_element_factory_make(info->video_parser, NULL);
+  elements[n++] = gst_element_factory_make(info->video_decoder, NULL);
+  elements[n++] = gst_element_factory_make("ffmpegcolorspace", NULL);
+  elements[n++] = gst_element_factory_make("videoscale", NULL);
+  elements[n++] = video_sink;
+
+  if (elements[0]) {
+    g_object_set(G_OBJECT(elements[0]), "location", info->path, NULL);
+    engine_source_use_mmap(elements[0]);
+  }
+
+  if ((bin = gst_bin_new(NULL)) != NULL)
+    if (!add_chain(GST_BIN(bin), elements, n)) {
+      g_warning("engine_still_bin_new: Failed to build the graph for %s\n", info->path);
+      gst_object_unref(bin);
+      bin = NULL;
+    }
+
+  if (bin && duration_ms > 0)
+    if ((pad = gst_element_get_static_pad(elements[n - 2], "src")) != NULL) {
+      gst_pad_add_event_probe(pad, (GCallback)drop_eos, NULL);
+      gst_object_unref(pad);
+    }
+
+  gst_object_unref(video_sink);
+
+  return bin;
+}
+
+/* A silent audio stream, for logos configured with sound=s */
+GstElement *
+engine_silence_bin_new()
+{
+  GstElement *bin = NULL, *elements[3];
+
+  elements[0] = gst_element_factory_make("audiotestsrc", NULL);
+  elements[1] = gst_element_factory_make("volume", NULL);
+  elements[2] = gst_element_factory_make("autoaudiosink", NULL);
+  if (elements[1])
+    g_object_set(G_OBJECT(elements[1]), "volume", 0.0, NULL);
+
+  if ((bin = gst_bin_new(NULL)) != NULL)
+    if (!add_chain(GST_BIN(bin), elements, 3)) {
+      gst_object_unref(bin);
+      bin = NULL;
+    }
+
+  return bin;
+}
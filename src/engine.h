@@ -0,0 +1,41 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _ENGINE_H_
+#define _ENGINE_H_
+
+#include <glib.h>
+#include <gst/gst.h>
+#include "mediainfo.h"
+
+G_BEGIN_DECLS
+
+gboolean engine_can_play(const MediaInfo *info, gboolean want_video);
+GstElement *engine_file_bin_new(const MediaInfo *info, GstElement *video_sink, GstElement *audio_sink);
+GstElement *engine_silence_bin_new();
+GstElement *engine_still_bin_new(const MediaInfo *info, GstElement *video_sink, int duration_ms);
+void engine_source_use_mmap(GstElement *src);
+
+G_END_DECLS
+
+#endif /* !_ENGINE_H_ */
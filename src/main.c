@@ -25,47 +25,34 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <glib.h>
-#include <gst/interfaces/xoverlay.h>
 #include <X11/Xlib.h>
-#include <X11/extensions/Xcomposite.h>
 #include <gst/gst.h>
-#include <libprofile.h>
 #include <fcntl.h>
-#ifdef HAVE_MCE
-# include <dbus/dbus.h>
-# include <mce/dbus-names.h>
-#endif /* HAVE_MCE */
+#include <libprofile.h>
+#include "check.h"
 #include "conffile.h"
-
-#define KILL_TO_LENGTH_MS 60000
-
-#define DEFAULT_VIDEO_PIPELINE_STR " playbin2 uri=file://%s " /* " flags=99 " <-- doesn't work with still images */
-#define DEFAULT_AUDIO_PIPELINE_STR " filesrc location=%s ! decodebin2 ! autoaudiosink "
-#define DEFAULT_SHUSH_PIPELINE_STR " audiotestsrc ! volume volume=0 ! autoaudiosink "
-#define AUDIO_FAKESINK " audio-sink=fakesink "
-#define SILENT_PROFILE "silent"
-
-static char *video_pipeline_str = DEFAULT_VIDEO_PIPELINE_STR;
-static char *audio_pipeline_str = DEFAULT_AUDIO_PIPELINE_STR;
-static char *shush_pipeline_str = DEFAULT_SHUSH_PIPELINE_STR;
-static Window dst_window = 0;
-
-#define TIMEOUT_PARAMS_STATIC_INIT { \
-  .timer = NULL,                     \
-  .to_ms = 0,                        \
-  .pipeline = NULL,                  \
-  .timeout_id = 0,                   \
-  .warning = NULL                    \
-}
-
-typedef struct
-{
-  GTimer *timer;
-  guint to_ms;
-  GstElement *pipeline;
-  guint timeout_id;
-  const char *warning;
-} TimeoutParams;
+#include "control.h"
+#include "finished.h"
+#include "mediainfo.h"
+#include "player.h"
+#include "poster.h"
+#include "readahead.h"
+#include "reaper.h"
+#include "registry.h"
+#include "trace.h"
+
+static PlayerOptions player_options = PLAYER_OPTIONS_STATIC_INIT;
+static gboolean update_cache = FALSE;
+static char *trace_file = NULL;
+static char *conf_dir = NULL;
+static char *state_dir = NULL;
+static char *finished_file = FINISHED_FILE;
+static char *control_socket = NULL;
+static char *readahead_manifest = READAHEAD_MANIFEST;
+static gboolean build_registry = FALSE;
+static char *control_command = NULL;
+static gboolean record_readahead = FALSE;
+static gboolean check = FALSE;
 
 static void
 my_log_func(const gchar *log_domain, GLogLevelFlags log_level, const char *message, gpointer null)
@@ -81,224 +68,107 @@ my_log_func(const gchar *log_domain, GLogLevelFlags log_level, const char *messa
   g_free(new_msg);
 }
 
-static Window
-get_dst_window(Display *dpy) {
-  Window ret = 0, xcomposite_window = 0;
-  if ((ret = DefaultRootWindow(dpy)) != 0)
-    if ((xcomposite_window = XCompositeGetOverlayWindow(dpy, ret)) != 0) {
-      g_debug("get_dst_window: Acquired XComposite overlay window %d\n", (int)xcomposite_window);
-      ret = xcomposite_window;
-    }
-
-  return ret;
-}
-
-static Window
-release_dst_window(Display *dpy, Window wnd)
-{
-  Window window = 0;
-  if ((window = DefaultRootWindow(dpy)) != 0)
-    if (wnd != window) {
-      g_debug("release_dst_window: Releasing XComposite overlay window %d\n", (int)wnd);
-      XCompositeReleaseOverlayWindow(dpy, wnd);
-    }
-
-  return (Window)0;
-}
-
-static gboolean
-post_eos(TimeoutParams *tp)
-{
-  if (tp->timer) {
-    double diff_ms = ((double)(tp->to_ms)) - (g_timer_elapsed(tp->timer, NULL) * 1000.0);
-    if (diff_ms > 0) {
-      g_warning("post_eos: False alarm! %lf ms () left\n", diff_ms);
-      tp->timeout_id = g_timeout_add((guint)diff_ms, (GSourceFunc)post_eos, tp);
-      return FALSE;
-    }
-  }
-  if (tp->warning) {
-    g_warning("post_eos: FATAL: Exiting: cannot play further logos: %s", tp->warning);
-    _Exit(1);
-  }
-  gst_bus_post(gst_pipeline_get_bus(GST_PIPELINE(tp->pipeline)), gst_message_new_eos(GST_OBJECT(tp->pipeline)));
-
-  tp->timeout_id = 0;
-  if (tp->timer) {
-    g_timer_destroy(tp->timer);
-    tp->timer = NULL;
-  }
-  return FALSE;
-}
-
-static void
-post_eos_timeout_add(guint to_ms, GstElement *pipeline, char *warning, TimeoutParams *params)
-{
-  params->to_ms = to_ms;
-  params->pipeline = pipeline;
-  params->warning = warning;
-  params->timer = g_timer_new();
-  params->timeout_id = g_timeout_add(to_ms, (GSourceFunc)post_eos, params);
-}
-
-static void
-post_eos_timeout_remove(TimeoutParams *params)
-{
-  if (params->timeout_id) {
-    g_source_remove(params->timeout_id);
-    params->timeout_id = 0;
-  }
-  if (params->timer) {
-    g_timer_destroy(params->timer);
-    params->timer = NULL;
-  }
-}
-
 static void
 touch_the_file_in_tmp()
 {
   int fd = -1;
 
-  fd = open("/tmp/hildon-welcome-is-finished", O_CREAT);
+  fd = open(finished_file, O_CREAT | O_WRONLY | O_TRUNC, 0644);
   if (fd >= 0)
     close(fd);
   else
     g_warning("touch_the_file_in_tmp: Failed to create the file\n");
 }
 
-static void
-wait_for_eos(GstElement *pipeline, Display *dpy, int duration, TimeoutParams *play_to)
+/* Commands arriving on the control socket */
+static char *
+control_handler(const char *command, Player *player)
 {
-  GError *err = NULL;
-  char *debug = NULL;
-  gboolean keep_looping = TRUE;
-  GstMessage *message = NULL;
-
-  while (keep_looping) {
-    message = gst_bus_poll(gst_pipeline_get_bus(GST_PIPELINE(pipeline)), GST_MESSAGE_ANY, -1);
-    if (!message) break;
-
-    switch(GST_MESSAGE_TYPE(message)) {
-      case GST_MESSAGE_ASYNC_DONE:
-        g_debug("wait_for_eos: Ready to play: duration = %d\n", duration);
-        if ((duration > 500) && !(play_to->timeout_id))
-          post_eos_timeout_add(duration, pipeline, NULL, play_to);
-        break;
-
-      case GST_MESSAGE_ERROR:
-        gst_message_parse_error(message, &err, &debug);
-        g_warning("wait_for_eos: %s: %s %s\n", GST_MESSAGE_TYPE_NAME(message), err ? err->message : "", debug ? debug : "");
-        if (err)
-          g_error_free(err);
-        g_free(debug);
-        /* fall through */
-      case GST_MESSAGE_EOS:
-        keep_looping = FALSE;
-        gst_element_set_state(pipeline, GST_STATE_PAUSED);
-        g_debug("wait_for_eos: Gst message: %s", GST_MESSAGE_TYPE_NAME(message));
-        break;
-
-      case GST_MESSAGE_ELEMENT:
-        if (gst_structure_has_name(message->structure, "prepare-xwindow-id")) {
-          if (0 == dst_window)
-            dst_window = get_dst_window(dpy);
-          if (dst_window)
-            gst_x_overlay_set_xwindow_id(GST_X_OVERLAY(GST_MESSAGE_SRC(message)), dst_window);
-        }
-        break;
-
-      default:
-        break;
-    }
-    gst_message_unref(message);
-  }
+  if (g_str_equal(command, "skip"))
+    return g_strdup(player_skip(player) ? "ok" : "error: not playing");
+  else
+  if (g_str_equal(command, "finish"))
+    return g_strdup(player_stop(player) ? "ok" : "error: not playing");
+  else
+  if (g_str_equal(command, "status"))
+    return player_get_status(player);
+
+  return g_strdup_printf("error: unknown command '%s'", command);
 }
 
-static void
-unblank_screen()
+static gboolean
+help_requested(int argc, char **argv)
 {
-#ifdef HAVE_MCE
-  DBusConnection *conn = NULL;
+  int Nix;
 
-  if ((conn = dbus_bus_get(DBUS_BUS_SYSTEM, NULL)) != NULL) {
-    DBusMessage *message, *reply;
+  for (Nix = 1 ; Nix < argc ; Nix++)
+    if (g_str_equal(argv[Nix], "-h") || g_str_equal(argv[Nix], "-?") || g_str_has_prefix(argv[Nix], "--help"))
+      return TRUE;
 
-    if ((message = dbus_message_new_method_call(MCE_SERVICE, MCE_REQUEST_PATH, MCE_REQUEST_IF, MCE_DISPLAY_ON_REQ)) != NULL) {
-      if ((reply = dbus_connection_send_with_reply_and_block(conn, message, -1, NULL)) != NULL)
-        dbus_message_unref(reply);
-      dbus_message_unref(message);
-    }
-  }
-#endif /* HAVE_MCE */
+  return FALSE;
 }
 
-static GstElement *
-play_logo(Display *dpy, char *video, char *audio, int duration)
+typedef struct
 {
-  GstElement* pipeline = NULL;
-  GString *pipeline_str = g_string_new("");
-
-  g_debug("play_logo: playing (video = '%s', audio = '%s', duration = '%d')", video, audio, duration);
+  int *p_argc;
+  char ***p_argv;
+} GstInitArgs;
 
-  if (video && video[0]) {
-    g_string_append_printf(pipeline_str, video_pipeline_str, video);
-
-    // in silent mode audio is routed to fakesink 
-    // this is a workaround for a pulseaudio performance problem
-    const char *profile = profile_get_profile();
-    if (g_str_equal(profile, SILENT_PROFILE)) {
-        g_string_append(pipeline_str, AUDIO_FAKESINK);
-    }
-  }
-
-  if (audio && audio[0]) {
-    if ('s' == audio[0] && 0 == audio[1])
-      g_string_append_printf(pipeline_str, shush_pipeline_str);
-    else
-      g_string_append_printf(pipeline_str, audio_pipeline_str, audio);
-  }
+static gpointer
+gst_init_thread(GstInitArgs *args)
+{
+  gint64 start = trace_now();
 
-  g_debug("pipeline str: %s", pipeline_str->str);
-  pipeline = gst_parse_launch(pipeline_str->str, NULL);
-  g_string_free(pipeline_str, TRUE);
+  gst_init(args->p_argc, args->p_argv);
+  trace_complete("gst_init", start, NULL);
 
-  if (pipeline) {
-    TimeoutParams kill_to = TIMEOUT_PARAMS_STATIC_INIT,
-                  play_to = TIMEOUT_PARAMS_STATIC_INIT;
+  return NULL;
+}
 
-    post_eos_timeout_add(KILL_TO_LENGTH_MS, pipeline, "Absolute timeout reached!\n", &kill_to);
+/* Open the configuration, resolve the profile and connect to the bus, which only the player needs */
+static gpointer
+conf_init_thread(gpointer null)
+{
+  Playlist *playlist = NULL;
+  char *profile = NULL;
+  gint64 start = trace_now();
 
-    gst_element_set_state(pipeline, GST_STATE_PLAYING);
-    unblank_screen();
-    wait_for_eos(pipeline, dpy, duration, &play_to);
+  playlist = conf_dir ? playlist_new_for_path(conf_dir) : playlist_new();
+  trace_complete("playlist_new", start, NULL);
 
-    post_eos_timeout_remove(&kill_to);
-    post_eos_timeout_remove(&play_to);
+  start = trace_now();
+  if ((profile = profile_get_profile()) != NULL) {
+    player_options.silent = g_str_equal(profile, SILENT_PROFILE);
+    free(profile);
   }
+  trace_complete("profile_get_profile", start, NULL);
+
+  player_connect_system_bus();
 
-  return pipeline;
+  return playlist;
 }
 
-/* Paint a black filled rectangle over the given window */
+/*
+ * Keep the poster in step with the first logo that has a video. The root
+ * window has the geometry and visual of the overlay window the poster is
+ * shown on.
+ */
 static void
-draw_black(Display *dpy, Window wnd)
+update_poster(Display *display, Playlist *playlist)
 {
-  XGCValues vals;
-  Window root_window;
-  int x, y;
-  unsigned int cx, cy, cx_border, depth;
-
-  if (!XGetGeometry(dpy, wnd, &root_window, &x, &y, &cx, &cy, &cx_border, &depth)) {
-     x =   0;  y =   0;
-    cx = 800; cy = 480;
-  }
-
-  vals.foreground = BlackPixel(dpy, 0);
-  vals.background = BlackPixel(dpy, 0);
-  GC gc = XCreateGC(dpy, wnd, GCForeground | GCBackground, &vals);
-  XFillRectangle(dpy, wnd, gc, x, y, cx, cy);
-  XFreeGC(dpy, gc);
-  XFlush(dpy);
+  Window wnd = DefaultRootWindow(display);
+  XWindowAttributes attrs;
+  const PlaylistEntry *entry = NULL;
+  guint Nix;
+
+  /* The same variant as the player's */
+  if (XGetWindowAttributes(display, wnd, &attrs))
+    playlist_set_resolution(playlist, attrs.width, attrs.height);
+  for (Nix = 0 ; (entry = playlist_get_entry(playlist, Nix)) != NULL ; Nix++)
+    if (entry->video && entry->video[0] && PLAYLIST_ENTRY_PLAYABLE(entry)) {
+      poster_update(display, wnd, playlist_get_video(playlist, Nix));
+      break;
+    }
 }
 
 int
@@ -310,7 +180,7 @@ main(int argc, char **argv)
       .short_name = 'a',
       .flags = G_OPTION_FLAG_OPTIONAL_ARG, 
       .arg = G_OPTION_ARG_STRING,
-      .arg_data = &audio_pipeline_str,
+      .arg_data = &(player_options.audio_pipeline_str),
       .description = "Audio pipeline string. May contain %s for the filename.",
       .arg_description = "'" DEFAULT_AUDIO_PIPELINE_STR "'"
     },
@@ -319,7 +189,7 @@ main(int argc, char **argv)
       .short_name = 'v',
       .flags = G_OPTION_FLAG_OPTIONAL_ARG, 
       .arg = G_OPTION_ARG_STRING,
-      .arg_data = &video_pipeline_str,
+      .arg_data = &(player_options.video_pipeline_str),
       .description = "Video pipeline string. May contain %s for the filename.",
       .arg_description = "'" DEFAULT_VIDEO_PIPELINE_STR "'"
     },
@@ -328,20 +198,129 @@ main(int argc, char **argv)
       .short_name = 's',
       .flags = G_OPTION_FLAG_OPTIONAL_ARG, 
       .arg = G_OPTION_ARG_STRING,
-      .arg_data = &shush_pipeline_str,
+      .arg_data = &(player_options.shush_pipeline_str),
       .description = "Silence pipeline string.",
       .arg_description = "'" DEFAULT_SHUSH_PIPELINE_STR "'"
     },
+    {
+      .long_name = "lookahead",
+      .short_name = 'l',
+      .flags = 0,
+      .arg = G_OPTION_ARG_NONE,
+      .arg_data = &(player_options.lookahead),
+      .description = "Preroll the next logo while the current one is playing.",
+      .arg_description = NULL
+    },
+    {
+      .long_name = "persistent",
+      .short_name = 'p',
+      .flags = 0,
+      .arg = G_OPTION_ARG_NONE,
+      .arg_data = &(player_options.persistent),
+      .description = "Play all logos through one playbin2, keeping its sinks across logos.",
+      .arg_description = NULL
+    },
+    {
+      .long_name = "snapshot",
+      .short_name = 0,
+      .flags = 0,
+      .arg = G_OPTION_ARG_NONE,
+      .arg_data = &(player_options.snapshot),
+      .description = "Hold the last frame of a logo as a window background and free its pipeline right away.",
+      .arg_description = NULL
+    },
+    {
+      .long_name = "control",
+      .short_name = 'c',
+      .flags = 0,
+      .arg = G_OPTION_ARG_STRING,
+      .arg_data = &control_command,
+      .description = "Send a command to the running instance, print its reply and exit. "
+                     "skip: end the current logo, finish: end the animation on a black screen, "
+                     "status: print 'playing <logo> <position> <duration> <remaining> <file>' with times in ms.",
+      .arg_description = "skip|finish|status"
+    },
+    {
+      .long_name = "record-readahead",
+      .short_name = 0,
+      .flags = 0,
+      .arg = G_OPTION_ARG_NONE,
+      .arg_data = &record_readahead,
+      .description = "Record what this run reads into the readahead manifest used by the following boots. "
+                     "Meant for a run with a cold page cache.",
+      .arg_description = NULL
+    },
+    {
+      .long_name = "update-cache",
+      .short_name = 0,
+      .flags = 0,
+      .arg = G_OPTION_ARG_NONE,
+      .arg_data = &update_cache,
+      .description = "Compile the logo configuration, probe its media and the video sinks for a faster startup, then exit.",
+      .arg_description = NULL
+    },
+    {
+      .long_name = "check",
+      .short_name = 0,
+      .flags = 0,
+      .arg = G_OPTION_ARG_NONE,
+      .arg_data = &check,
+      .description = "Preroll and decode every configured logo with fake sinks, report what each costs, then exit.",
+      .arg_description = NULL
+    },
+    {
+      .long_name = "trace-file",
+      .short_name = 0,
+      .flags = 0,
+      .arg = G_OPTION_ARG_FILENAME,
+      .arg_data = &trace_file,
+      .description = "Write a boot timeline in the Chrome trace event format to this file.",
+      .arg_description = "FILE"
+    },
+    {
+      .long_name = "conf-dir",
+      .short_name = 0,
+      .flags = G_OPTION_FLAG_HIDDEN,
+      .arg = G_OPTION_ARG_FILENAME,
+      .arg_data = &conf_dir,
+      .description = "Play the .conf files in this directory instead. Used by the benchmark.",
+      .arg_description = "DIR"
+    },
+    {
+      .long_name = "state-dir",
+      .short_name = 0,
+      .flags = G_OPTION_FLAG_HIDDEN,
+      .arg = G_OPTION_ARG_FILENAME,
+      .arg_data = &state_dir,
+      .description = "Keep the media cache, the video sink choice, the readahead manifest, the completion flag and "
+                     "the control socket in this directory instead, and show no poster. "
+                     "With --update-cache, only the media cache and the video sink choice are written. Used by the benchmark.",
+      .arg_description = "DIR"
+    },
+    {
+      .long_name = PRIVATE_REGISTRY_BUILD_OPTION,
+      .short_name = 0,
+      .flags = G_OPTION_FLAG_HIDDEN,
+      .arg = G_OPTION_ARG_NONE,
+      .arg_data = &build_registry,
+      .description = "Initialise GStreamer, writing its registry, and exit. Used by --update-cache.",
+      .arg_description = NULL
+    },
     { NULL }
   };
 
   GOptionContext *ctx;
   GError *err;
   Display *display = NULL;
-  char *video = NULL, *audio = NULL;
-  int duration;
-  ConfFileIterator *itr;
-  GstElement *new_pipeline = NULL, *old_pipeline = NULL;
+  Window dst_window = 0;
+  Playlist *playlist = NULL;
+  Player *player = NULL;
+  GMainLoop *loop = NULL;
+  Control *control = NULL;
+  GThread *gst_thread = NULL, *conf_thread = NULL;
+  GstInitArgs gst_args = { &argc, &argv };
+  gint64 boot_start = trace_now(), start = 0;
+  int Nix;
 
   g_setenv("PULSE_PROP_media.role", "animation", TRUE);
 
@@ -349,47 +328,197 @@ main(int argc, char **argv)
 
   g_log_set_default_handler(my_log_func, NULL);
 
+  start = trace_now();
   ctx = g_option_context_new(NULL);
   g_option_context_add_main_entries (ctx, options, NULL);
-  g_option_context_add_group (ctx, gst_init_get_option_group());
+  /*
+   * Parsing GStreamer's options initialises it, so they are left in argv
+   * for gst_init() and their group is only there for the help.
+   */
+  if (help_requested(argc, argv))
+    g_option_context_add_group (ctx, gst_init_get_option_group());
+  else
+    g_option_context_set_ignore_unknown_options(ctx, TRUE);
   if (!g_option_context_parse (ctx, &argc, &argv, &err))
     g_error ("main: Error parsing command line: %s\n", err ? err->message : "Unknown error\n");
   g_option_context_free (ctx);
+  for (Nix = 1 ; Nix < argc ; Nix++)
+    if ('-' == argv[Nix][0] && !g_str_has_prefix(argv[Nix], "--gst-"))
+      g_error ("main: Unknown option %s\n", argv[Nix]);
+  trace_complete("options", start, NULL);
+
+  if (state_dir) {
+    finished_file = g_build_filename(state_dir, "finished", NULL);
+    control_socket = g_build_filename(state_dir, "control", NULL);
+    player_options.media_cache_file = g_build_filename(state_dir, "media.cache", NULL);
+    player_options.video_sink_cache_file = g_build_filename(state_dir, "videosink", NULL);
+    readahead_manifest = g_build_filename(state_dir, "readahead.manifest", NULL);
+  }
+  else
+    control_socket = control_default_path();
 
-  gst_init(&argc, &argv);
+  if (control_command) {
+    char *reply = NULL;
 
-  if (!(display = XOpenDisplay(NULL)))
-    g_error("main: Failed to open display\n");
+    if (!control_send(control_socket, control_command, &reply)) {
+      g_printerr("hildon-welcome is not running\n");
+      return 1;
+    }
+    g_print("%s\n", reply);
+    g_free(reply);
+    return 0;
+  }
+
+  if (build_registry) {
+    gst_init(&argc, &argv);
+    return 0;
+  }
+
+  /* Leaves the system caches alone */
+  if (update_cache && state_dir) {
+    gst_init(&argc, &argv);
+    if ((display = XOpenDisplay(NULL)) != NULL) {
+      player_video_sink_cache_update(display, player_options.video_sink_cache_file);
+      XCloseDisplay(display);
+    }
+    return media_info_cache_update(conf_dir, player_options.media_cache_file) ? 0 : 1;
+  }
 
-  if ((itr = conf_file_iterator_new())) {
-    while (conf_file_iterator_get(itr, &video, &audio, &duration)) {
-      new_pipeline = play_logo(display, video, audio, duration);
-      g_free(video); video = NULL;
-      g_free(audio); audio = NULL;
-      duration = 0;
-      if (old_pipeline) {
-        gst_element_set_state(old_pipeline, GST_STATE_NULL);
-        gst_object_unref(old_pipeline);
+  if (update_cache) {
+    gboolean success;
+
+    gst_init(&argc, &argv);
+    success = conf_file_cache_update();
+    success = media_info_cache_update(NULL, NULL) && success;
+    /* Not fatal: without a display, the first boot takes the poster and probes the sinks */
+    if ((display = XOpenDisplay(NULL)) != NULL) {
+      player_video_sink_cache_update(display, NULL);
+      if ((playlist = playlist_new()) != NULL) {
+        update_poster(display, playlist);
+        playlist_free(playlist);
       }
-      old_pipeline = new_pipeline;
+      XCloseDisplay(display);
     }
-    conf_file_iterator_destroy(itr);
+#ifdef USE_PRIVATE_REGISTRY
+    /* Not fatal: the system registry is used without it */
+    private_registry_update();
+#endif /* USE_PRIVATE_REGISTRY */
+    return success ? 0 : 1;
   }
 
-  /* Prevent the green flash before the application quits */
-  if (dst_window)
-    draw_black(display, dst_window);
+  /* With the system registry, which knows about media not deployed yet */
+  if (check) {
+    gboolean success = FALSE;
 
-  gst_element_set_state(new_pipeline, GST_STATE_NULL);
-  gst_object_unref(new_pipeline);
+    gst_init(&argc, &argv);
+    if ((playlist = conf_dir ? playlist_new_for_path(conf_dir) : playlist_new()) != NULL) {
+      success = check_run(playlist, player_options.media_cache_file);
+      playlist_free(playlist);
+    }
+    return success ? 0 : 1;
+  }
+
+  if (record_readahead) {
+    readahead_record_begin();
+    readahead_note(PLAYLIST_CACHE_FILE);
+    readahead_note(MEDIA_INFO_CACHE_FILE);
+    readahead_note(POSTER_FILE);
+    readahead_note(player_options.video_sink_cache_file ? player_options.video_sink_cache_file : VIDEO_SINK_CACHE_FILE);
+#ifdef USE_PRIVATE_REGISTRY
+    readahead_note(PRIVATE_REGISTRY_FILE);
+    readahead_note(PRIVATE_REGISTRY_STAMP_FILE);
+#endif /* USE_PRIVATE_REGISTRY */
+  }
+  else
+    readahead_replay(readahead_manifest);
+
+#ifdef USE_PRIVATE_REGISTRY
+  /* The private registry only has the plugins the system logos needed when it was built */
+  if (!conf_dir)
+    private_registry_use();
+#endif /* USE_PRIVATE_REGISTRY */
+
+  /*
+   * GStreamer, the configuration and X do not depend on each other, so
+   * initialise them side by side and join before the first pipeline.
+   */
+  if ((gst_thread = g_thread_create((GThreadFunc)gst_init_thread, &gst_args, TRUE, NULL)) == NULL)
+    gst_init_thread(&gst_args);
+  if ((conf_thread = g_thread_create(conf_init_thread, NULL, TRUE, NULL)) == NULL)
+    playlist = conf_init_thread(NULL);
+
+  start = trace_now();
+  if (!(display = XOpenDisplay(NULL)))
+    g_error("main: Failed to open display\n");
+  trace_complete("XOpenDisplay", start, NULL);
+
+  /* Put the first logo on screen before GStreamer is even initialised, unless it is not the system's */
+  start = trace_now();
+  if ((dst_window = get_dst_window(display)) != 0 && !state_dir)
+    poster_show(display, dst_window);
+  trace_complete("poster_show", start, NULL);
+
+  start = trace_now();
+  if (gst_thread)
+    g_thread_join(gst_thread);
+  if (conf_thread)
+    playlist = g_thread_join(conf_thread);
+  trace_complete("startup_join", start, NULL);
+
+  if (playlist) {
+    reaper_start();
+    if ((player = player_new(display, dst_window, playlist, &player_options)) != NULL) {
+      start = trace_now();
+      loop = g_main_loop_new(NULL, FALSE);
+      if ((control = control_new(control_socket, (ControlHandler)control_handler, player)) == NULL)
+        g_warning("main: No control socket, the animation cannot be skipped or finished\n");
+      player_start(player, (PlayerDoneFunc)g_main_loop_quit, loop);
+      g_main_loop_run(loop);
+      control_free(control);
+      g_main_loop_unref(loop);
+      trace_complete("playback", start, NULL);
+
+      /* Everything is still mapped */
+      if (record_readahead)
+        readahead_record_end(readahead_manifest);
+
+      start = trace_now();
+      player_destroy(player);
+      trace_complete("teardown", start, NULL);
+    }
+  }
 
-  if (dst_window)
+  /* Otherwise the player has released it */
+  if (!player && dst_window)
     release_dst_window(display, dst_window);
 
+  /* The screen is free: let the session go on while we clean up */
+  start = trace_now();
+  touch_the_file_in_tmp();
+  trace_complete("touch_the_file_in_tmp", start, NULL);
+
+  /*
+   * --update-cache normally takes the poster. This only catches up when the
+   * first logo has changed since, and does nothing if taking it failed.
+   */
+  if (playlist && !conf_dir) {
+    start = trace_now();
+    update_poster(display, playlist);
+    trace_complete("poster_update", start, NULL);
+  }
+  playlist_free(playlist);
+
   XCloseDisplay(display);
 
-  gst_deinit();
+  /* A teardown that hangs must not hang the exit as well */
+  start = trace_now();
+  if (reaper_stop(REAPER_TIMEOUT_MS))
+    gst_deinit();
+  trace_complete("gst_deinit", start, NULL);
+
+  trace_complete("main", boot_start, NULL);
+  if (trace_file)
+    trace_write(trace_file);
 
-  touch_the_file_in_tmp();
   return 0;
 }
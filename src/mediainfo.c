@@ -0,0 +1,493 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include "conffile.h"
+#include "mediainfo.h"
+
+#define PROBE_TIMEOUT (5 * GST_SECOND)
+
+struct _MediaInfoCache
+{
+  GHashTable *infos;
+};
+
+static void
+media_info_free(MediaInfo *info)
+{
+  if (!info) return;
+  g_free(info->path);
+  g_free(info->container_caps);
+  g_free(info->demuxer);
+  g_free(info->video_caps);
+  g_free(info->video_parser);
+  g_free(info->video_decoder);
+  g_free(info->audio_caps);
+  g_free(info->audio_parser);
+  g_free(info->audio_decoder);
+  g_free(info);
+}
+
+static gboolean
+file_stat(const char *path, gint64 *p_mtime, gint64 *p_size)
+{
+  struct stat st;
+
+  if (g_stat(path, &st) != 0)
+    return FALSE;
+
+  (*p_mtime) = (gint64)(st.st_mtime);
+  (*p_size) = (gint64)(st.st_size);
+  return TRUE;
+}
+
+/* Read a key that may be absent, turning "" into NULL */
+static char *
+key_file_get_string(GKeyFile *file, const char *group, const char *key)
+{
+  char *str = g_key_file_get_string(file, group, key, NULL);
+
+  if (str && !str[0]) {
+    g_free(str);
+    str = NULL;
+  }
+
+  return str;
+}
+
+static gint64
+key_file_get_int64(GKeyFile *file, const char *group, const char *key, gint64 default_value)
+{
+  gint64 ret = default_value;
+  char *str = NULL;
+
+  if ((str = g_key_file_get_string(file, group, key, NULL)) != NULL) {
+    ret = g_ascii_strtoll(str, NULL, 10);
+    g_free(str);
+  }
+
+  return ret;
+}
+
+static void
+key_file_set_int64(GKeyFile *file, const char *group, const char *key, gint64 value)
+{
+  char *str = g_strdup_printf("%" G_GINT64_FORMAT, value);
+  g_key_file_set_string(file, group, key, str);
+  g_free(str);
+}
+
+static void
+key_file_set_string(GKeyFile *file, const char *group, const char *key, const char *value)
+{
+  if (value)
+    g_key_file_set_string(file, group, key, value);
+}
+
+/* cache_file is NULL for MEDIA_INFO_CACHE_FILE */
+MediaInfoCache *
+media_info_cache_load(const char *cache_file)
+{
+  MediaInfoCache *cache = NULL;
+  GKeyFile *file = NULL;
+  char **groups = NULL;
+  MediaInfo *info = NULL;
+  int Nix;
+
+  if (!cache_file)
+    cache_file = MEDIA_INFO_CACHE_FILE;
+
+  if ((cache = g_new0(MediaInfoCache, 1)) == NULL)
+    return NULL;
+
+  cache->infos = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)media_info_free);
+
+  if ((file = g_key_file_new()) != NULL) {
+    if (g_key_file_load_from_file(file, cache_file, G_KEY_FILE_NONE, NULL)) {
+      if ((groups = g_key_file_get_groups(file, NULL)) != NULL) {
+        for (Nix = 0 ; groups[Nix] ; Nix++)
+          if ((info = g_new0(MediaInfo, 1)) != NULL) {
+            info->path = g_strdup(groups[Nix]);
+            info->mtime = key_file_get_int64(file, groups[Nix], "mtime", -1);
+            info->size = key_file_get_int64(file, groups[Nix], "size", -1);
+            info->container_caps = key_file_get_string(file, groups[Nix], "container");
+            info->demuxer = key_file_get_string(file, groups[Nix], "demuxer");
+            info->video_caps = key_file_get_string(file, groups[Nix], "video-caps");
+            info->video_parser = key_file_get_string(file, groups[Nix], "video-parser");
+            info->video_decoder = key_file_get_string(file, groups[Nix], "video-decoder");
+            info->audio_caps = key_file_get_string(file, groups[Nix], "audio-caps");
+            info->audio_parser = key_file_get_string(file, groups[Nix], "audio-parser");
+            info->audio_decoder = key_file_get_string(file, groups[Nix], "audio-decoder");
+            info->width = g_key_file_get_integer(file, groups[Nix], "width", NULL);
+            info->height = g_key_file_get_integer(file, groups[Nix], "height", NULL);
+            info->duration = key_file_get_int64(file, groups[Nix], "duration", -1);
+            info->is_image = g_key_file_get_boolean(file, groups[Nix], "image", NULL);
+            g_hash_table_insert(cache->infos, info->path, info);
+          }
+        g_strfreev(groups);
+      }
+    }
+    else
+      g_debug("media_info_cache_load: No media cache at %s", cache_file);
+    g_key_file_free(file);
+  }
+
+  return cache;
+}
+
+/* Return the cached information for path, provided the file has not changed since */
+const MediaInfo *
+media_info_cache_lookup(MediaInfoCache *cache, const char *path)
+{
+  MediaInfo *info = NULL;
+  gint64 mtime = 0, size = 0;
+
+  if (!(cache && path)) return NULL;
+
+  if ((info = g_hash_table_lookup(cache->infos, path)) != NULL)
+    if (!file_stat(path, &mtime, &size) || mtime != info->mtime || size != info->size) {
+      g_debug("media_info_cache_lookup: %s has changed", path);
+      info = NULL;
+    }
+
+  return info;
+}
+
+void
+media_info_cache_free(MediaInfoCache *cache)
+{
+  if (!cache) return;
+  g_hash_table_destroy(cache->infos);
+  g_free(cache);
+}
+
+/* Give every decoded stream a fakesink, so that the probe pipeline can preroll */
+static void
+probe_new_decoded_pad(GstElement *decodebin, GstPad *pad, gboolean last, GstElement *pipeline)
+{
+  GstElement *sink = NULL;
+  GstPad *sink_pad = NULL;
+
+  if ((sink = gst_element_factory_make("fakesink", NULL)) != NULL) {
+    gst_bin_add(GST_BIN(pipeline), sink);
+    gst_element_set_state(sink, GST_STATE_PAUSED);
+    if ((sink_pad = gst_element_get_static_pad(sink, "sink")) != NULL) {
+      gst_pad_link(pad, sink_pad);
+      gst_object_unref(sink_pad);
+    }
+  }
+}
+
+/* Return the media type of the caps negotiated on the element's pad */
+static char *
+pad_media_type(GstElement *element, const char *pad_name, int *p_width, int *p_height)
+{
+  GstPad *pad = NULL;
+  GstCaps *caps = NULL;
+  GstStructure *structure = NULL;
+  char *ret = NULL;
+
+  if ((pad = gst_element_get_static_pad(element, pad_name)) != NULL) {
+    if ((caps = gst_pad_get_negotiated_caps(pad)) != NULL) {
+      if (gst_caps_get_size(caps) > 0)
+        if ((structure = gst_caps_get_structure(caps, 0)) != NULL) {
+          ret = g_strdup(gst_structure_get_name(structure));
+          if (p_width)
+            gst_structure_get_int(structure, "width", p_width);
+          if (p_height)
+            gst_structure_get_int(structure, "height", p_height);
+        }
+      gst_caps_unref(caps);
+    }
+    gst_object_unref(pad);
+  }
+
+  return ret;
+}
+
+static gboolean
+is_video_type(const char *media_type)
+{
+  return media_type && (g_str_has_prefix(media_type, "video/") || g_str_has_prefix(media_type, "image/"));
+}
+
+/* Record the role of one element that decodebin2 plugged. The first element found for a role is kept. */
+static void
+probe_classify(MediaInfo *info, GstElement *element)
+{
+  GstElementFactory *factory = NULL;
+  const char *name = NULL, *klass = NULL;
+  char *media_type = NULL;
+  GstCaps *caps = NULL;
+
+  if ((factory = gst_element_get_factory(element)) == NULL)
+    return;
+
+  name = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+  klass = gst_element_factory_get_klass(factory);
+
+  if (!strcmp(name, "typefind")) {
+    g_object_get(G_OBJECT(element), "caps", &caps, NULL);
+    if (caps) {
+      if (gst_caps_get_size(caps) > 0 && !(info->container_caps))
+        info->container_caps = g_strdup(gst_structure_get_name(gst_caps_get_structure(caps, 0)));
+      gst_caps_unref(caps);
+    }
+  }
+  else
+  if (strstr(klass, "Demux")) {
+    if (!(info->demuxer))
+      info->demuxer = g_strdup(name);
+  }
+  else
+  if (strstr(klass, "Parser")) {
+    media_type = pad_media_type(element, "sink", NULL, NULL);
+    if (is_video_type(media_type)) {
+      if (!(info->video_parser) && !(info->video_decoder))
+        info->video_parser = g_strdup(name);
+    }
+    else
+    if (media_type && g_str_has_prefix(media_type, "audio/")) {
+      if (!(info->audio_parser) && !(info->audio_decoder))
+        info->audio_parser = g_strdup(name);
+    }
+  }
+  else
+  if (strstr(klass, "Decoder")) {
+    media_type = pad_media_type(element, "sink", NULL, NULL);
+    if (is_video_type(media_type)) {
+      if (!(info->video_decoder)) {
+        info->video_decoder = g_strdup(name);
+        g_free(info->video_caps);
+        info->video_caps = media_type; media_type = NULL;
+        g_free(pad_media_type(element, "src", &(info->width), &(info->height)));
+      }
+    }
+    else
+    if (media_type && g_str_has_prefix(media_type, "audio/")) {
+      if (!(info->audio_decoder)) {
+        info->audio_decoder = g_strdup(name);
+        g_free(info->audio_caps);
+        info->audio_caps = media_type; media_type = NULL;
+      }
+    }
+  }
+
+  g_free(media_type);
+}
+
+/*
+ * Classify element and everything downstream of it, one stream after the
+ * other, so that a stream's parser and decoder are both found before the
+ * next stream is looked at. The walk ends at decodebin2's ghost pads.
+ */
+static void
+probe_walk(MediaInfo *info, GstElement *element, GHashTable *visited)
+{
+  GstIterator *itr = NULL;
+  GstElement *next = NULL;
+  GstPad *pad = NULL, *peer = NULL;
+
+  if (g_hash_table_lookup(visited, element))
+    return;
+  g_hash_table_insert(visited, element, element);
+
+  probe_classify(info, element);
+
+  if ((itr = gst_element_iterate_src_pads(element)) != NULL) {
+    while (GST_ITERATOR_OK == gst_iterator_next(itr, ((gpointer *)(&pad)))) {
+      if ((peer = gst_pad_get_peer(pad)) != NULL) {
+        if ((next = gst_pad_get_parent_element(peer)) != NULL) {
+          probe_walk(info, next, visited);
+          gst_object_unref(next);
+        }
+        gst_object_unref(peer);
+      }
+      gst_object_unref(pad);
+    }
+    gst_iterator_free(itr);
+  }
+}
+
+/* Preroll the file through decodebin2 and note down what got plugged */
+static MediaInfo *
+media_info_probe(const char *path)
+{
+  MediaInfo *info = NULL;
+  GstElement *pipeline = NULL, *filesrc = NULL, *decodebin = NULL, *element = NULL;
+  GHashTable *visited = NULL;
+  GstMessage *message = NULL;
+  GstBus *bus = NULL;
+  GstFormat format = GST_FORMAT_TIME;
+  gint64 duration = -1;
+
+  if ((info = g_new0(MediaInfo, 1)) == NULL)
+    return NULL;
+
+  info->path = g_strdup(path);
+  info->duration = -1;
+  if (!file_stat(path, &(info->mtime), &(info->size))) {
+    media_info_free(info);
+    return NULL;
+  }
+
+  pipeline = gst_pipeline_new("probe");
+  filesrc = gst_element_factory_make("filesrc", NULL);
+  decodebin = gst_element_factory_make("decodebin2", NULL);
+  if (!(pipeline && filesrc && decodebin)) {
+    g_warning("media_info_probe: Failed to create probe pipeline\n");
+    if (pipeline) gst_object_unref(pipeline);
+    if (filesrc) gst_object_unref(filesrc);
+    if (decodebin) gst_object_unref(decodebin);
+    media_info_free(info);
+    return NULL;
+  }
+
+  g_object_set(G_OBJECT(filesrc), "location", path, NULL);
+  g_signal_connect(G_OBJECT(decodebin), "new-decoded-pad", (GCallback)probe_new_decoded_pad, pipeline);
+  gst_bin_add_many(GST_BIN(pipeline), filesrc, decodebin, NULL);
+  gst_element_link(filesrc, decodebin);
+
+  gst_element_set_state(pipeline, GST_STATE_PAUSED);
+  if ((bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline))) != NULL) {
+    message = gst_bus_timed_pop_filtered(bus, PROBE_TIMEOUT, GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR);
+    gst_object_unref(bus);
+  }
+
+  if (message && GST_MESSAGE_ASYNC_DONE == GST_MESSAGE_TYPE(message)) {
+    /* From decodebin2's typefinder, along the links, so that only linked elements count */
+    if ((element = gst_bin_get_by_name(GST_BIN(decodebin), "typefind")) != NULL) {
+      visited = g_hash_table_new(g_direct_hash, g_direct_equal);
+      probe_walk(info, element, visited);
+      g_hash_table_destroy(visited);
+      gst_object_unref(element);
+    }
+    if (gst_element_query_duration(pipeline, &format, &duration) && GST_FORMAT_TIME == format)
+      info->duration = duration;
+    info->is_image = (!(info->demuxer) && info->video_caps && g_str_has_prefix(info->video_caps, "image/"));
+    g_debug("media_info_probe: %s: container = %s, demuxer = %s, video = %s/%s (%dx%d), audio = %s/%s",
+      path, info->container_caps, info->demuxer,
+      info->video_caps, info->video_decoder, info->width, info->height,
+      info->audio_caps, info->audio_decoder);
+  }
+  else {
+    g_warning("media_info_probe: Failed to preroll %s\n", path);
+    media_info_free(info);
+    info = NULL;
+  }
+
+  if (message)
+    gst_message_unref(message);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  return info;
+}
+
+static void
+media_info_save(GKeyFile *file, const MediaInfo *info)
+{
+  key_file_set_int64(file, info->path, "mtime", info->mtime);
+  key_file_set_int64(file, info->path, "size", info->size);
+  key_file_set_string(file, info->path, "container", info->container_caps);
+  key_file_set_string(file, info->path, "demuxer", info->demuxer);
+  key_file_set_string(file, info->path, "video-caps", info->video_caps);
+  key_file_set_string(file, info->path, "video-parser", info->video_parser);
+  key_file_set_string(file, info->path, "video-decoder", info->video_decoder);
+  key_file_set_string(file, info->path, "audio-caps", info->audio_caps);
+  key_file_set_string(file, info->path, "audio-parser", info->audio_parser);
+  key_file_set_string(file, info->path, "audio-decoder", info->audio_decoder);
+  g_key_file_set_integer(file, info->path, "width", info->width);
+  g_key_file_set_integer(file, info->path, "height", info->height);
+  key_file_set_int64(file, info->path, "duration", info->duration);
+  g_key_file_set_boolean(file, info->path, "image", info->is_image);
+}
+
+static void
+probe_and_save(GKeyFile *file, const char *path)
+{
+  MediaInfo *info = NULL;
+
+  if (g_key_file_has_group(file, path))
+    return;
+
+  if ((info = media_info_probe(path)) != NULL) {
+    media_info_save(file, info);
+    media_info_free(info);
+  }
+}
+
+/*
+ * Probe every media file referenced by the configuration and write the
+ * results to the media cache. conf_dir and cache_file are NULL for the
+ * system configuration and MEDIA_INFO_CACHE_FILE. Requires GStreamer to
+ * be initialised.
+ */
+gboolean
+media_info_cache_update(const char *conf_dir, const char *cache_file)
+{
+  Playlist *playlist = NULL;
+  const PlaylistEntry *entry = NULL;
+  GKeyFile *file = NULL;
+  char *data = NULL, *dir = NULL;
+  guint Nix;
+  int Nix1;
+  gsize length = 0;
+  gboolean ret = FALSE;
+
+  if (!cache_file)
+    cache_file = MEDIA_INFO_CACHE_FILE;
+
+  if ((playlist = conf_dir ? playlist_new_for_path(conf_dir) : playlist_new()) == NULL)
+    return FALSE;
+
+  file = g_key_file_new();
+  for (Nix = 0 ; (entry = playlist_get_entry(playlist, Nix)) != NULL ; Nix++) {
+    if (entry->video && entry->video[0])
+      probe_and_save(file, entry->video);
+    for (Nix1 = 0 ; entry->variants && entry->variants[Nix1] && entry->variants[Nix1 + 1] ; Nix1 += 2)
+      probe_and_save(file, entry->variants[Nix1 + 1]);
+    if (entry->audio && entry->audio[0] && !('s' == entry->audio[0] && 0 == entry->audio[1]))
+      probe_and_save(file, entry->audio);
+  }
+  playlist_free(playlist);
+
+  data = g_key_file_to_data(file, &length, NULL);
+  dir = g_path_get_dirname(cache_file);
+  if (data && g_mkdir_with_parents(dir, 0755) == 0 &&
+      g_file_set_contents(cache_file, data, length, NULL))
+    ret = TRUE;
+  else
+    g_warning("media_info_cache_update: Failed to write %s\n", cache_file);
+
+  g_free(dir);
+  g_free(data);
+  g_key_file_free(file);
+
+  return ret;
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _MEDIAINFO_H_
+#define _MEDIAINFO_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define MEDIA_INFO_CACHE_FILE LOCALSTATEDIR "/cache/" PACKAGE_NAME "/media.cache"
+
+/*
+ * What typefinding and autoplugging found out about a media file, so that
+ * the player can build the decoding chain without repeating the work.
+ * Element names are element factory names, caps are media types.
+ */
+typedef struct
+{
+  char *path;
+  gint64 mtime;
+  gint64 size;
+  char *container_caps;
+  char *demuxer;
+  char *video_caps;
+  char *video_parser;
+  char *video_decoder;
+  char *audio_caps;
+  char *audio_parser;
+  char *audio_decoder;
+  int width;
+  int height;
+  gint64 duration;
+  gboolean is_image;
+} MediaInfo;
+
+typedef struct _MediaInfoCache MediaInfoCache;
+
+MediaInfoCache *media_info_cache_load(const char *cache_file);
+const MediaInfo *media_info_cache_lookup(MediaInfoCache *cache, const char *path);
+void media_info_cache_free(MediaInfoCache *cache);
+gboolean media_info_cache_update(const char *conf_dir, const char *cache_file);
+
+G_END_DECLS
+
+#endif /* !_MEDIAINFO_H_ */
@@ -0,0 +1,1908 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <glib.h>
+#include <gst/interfaces/xoverlay.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/XShm.h>
+#include <gst/gst.h>
+#ifdef HAVE_MCE
+# include <dbus/dbus.h>
+# include <dbus/dbus-glib-lowlevel.h>
+# include <mce/dbus-names.h>
+#endif /* HAVE_MCE */
+#include "mediainfo.h"
+#include "player.h"
+#include "poster.h"
+#include "readahead.h"
+#include "reaper.h"
+#include "trace.h"
+#include "engine.h"
+
+#define KILL_TO_LENGTH_MS 60000
+
+#define AUTO_VIDEO_SINK "autovideosink"
+#define XV_VIDEO_SINK "xvimagesink handle-events=false"
+#define X_VIDEO_SINK "ximagesink handle-events=false"
+#define VIDEO_SINK_NAME "hildon-welcome-video-sink"
+#define MCE_CALL_TIMEOUT_MS 1000
+#define MCE_DISPLAY_SIG_MATCH "type='signal',interface='" MCE_SIGNAL_IF "',member='" MCE_DISPLAY_SIG "'"
+#define PLAY_FLAG_AUDIO (1 << 1)
+#define PLAY_FLAG_SOFT_VOLUME (1 << 4)
+#define PLAY_FLAG_NATIVE_AUDIO (1 << 5)
+#define PLAY_FLAG_NATIVE_VIDEO (1 << 6)
+#define LOGO_STARTED_MESSAGE "hildon-welcome-logo-started"
+#define LOGO_CUT_MESSAGE "hildon-welcome-logo-cut"
+
+/* A single-shot wait on a clock, ending in EOS, a message or an exit */
+typedef struct
+{
+  GstClockID id;
+  GstElement *pipeline;
+  const char *warning;
+  const char *message_name;
+} ClockTimeout;
+
+typedef enum
+{
+  PLAYER_STATE_IDLE,
+  PLAYER_STATE_PLAYING,
+  PLAYER_STATE_FINISHED
+} PlayerState;
+
+typedef struct
+{
+  Player *player;
+  GstElement *pipeline;
+  int duration;
+  gboolean started;
+  gboolean prerolled;
+  gboolean finished;
+  gboolean failed;
+  GstElement *video_sink;
+  guint bus_watch_id;
+  ClockTimeout kill_to;
+  ClockTimeout play_to;
+  gboolean playing;
+  char *name;
+  gint64 preroll_start;
+  gint64 play_start;
+  gboolean frame_ready;
+  GstPad *frame_pad;
+  gulong frame_probe_id;
+  gulong last_frame_probe_id;
+  GstBuffer *last_frame;
+  gboolean snapshot;
+  char *video;
+  char *audio;
+  gboolean engine;
+} Logo;
+
+typedef struct
+{
+  char *uri;
+  char *audio;
+  int duration;
+} PersistentEntry;
+
+typedef struct
+{
+  Logo *logo;
+  GMutex *lock;
+  PersistentEntry *current;
+  PersistentEntry *next;
+  gboolean next_queued;
+  volatile gint switch_pending;
+  gboolean start_pending;
+  Logo *sound;
+  GstElement *video_sink;
+  gulong probe_id;
+} PersistentPlayer;
+
+/* The last frame of a logo, converted for the window background in its own thread */
+typedef struct
+{
+  Player *player;
+  PosterSnapshot *snapshot;
+} SnapshotJob;
+
+struct _Player
+{
+  PlayerOptions options;
+  PlayerState state;
+  Display *dpy;
+  Window dst_window;
+  Playlist *playlist;
+  guint next_entry;
+  MediaInfoCache *media_info;
+  PlayerDoneFunc done;
+  gpointer done_data;
+  Logo *current;
+  Logo *next;
+  Logo *old;
+  guint advance_id;
+  guint preload_id;
+  PersistentPlayer *pp;
+  GThread *snapshot_thread;
+  SnapshotJob *snapshot_job;
+  Logo *snapshot_logo;
+  guint n_started;
+  char *video_sink_str;
+  gboolean native_video;
+#ifdef HAVE_MCE
+  DBusConnection *system_bus;
+  DBusPendingCall *status_call;
+  DBusPendingCall *unblank_call;
+  gboolean display_on;
+#endif /* HAVE_MCE */
+};
+
+static void player_schedule_advance(Player *player);
+static void logo_free(Logo *logo);
+static gboolean logo_fall_back(Logo *logo);
+static void player_finish(Player *player);
+static void get_window_geometry(Display *dpy, Window wnd, int *p_x, int *p_y, unsigned int *p_cx, unsigned int *p_cy);
+
+Window
+get_dst_window(Display *dpy) {
+  Window ret = 0, xcomposite_window = 0;
+  if ((ret = DefaultRootWindow(dpy)) != 0)
+    if ((xcomposite_window = XCompositeGetOverlayWindow(dpy, ret)) != 0) {
+      g_debug("get_dst_window: Acquired XComposite overlay window %d\n", (int)xcomposite_window);
+      ret = xcomposite_window;
+    }
+
+  return ret;
+}
+
+Window
+release_dst_window(Display *dpy, Window wnd)
+{
+  Window window = 0;
+  if ((window = DefaultRootWindow(dpy)) != 0)
+    if (wnd != window) {
+      g_debug("release_dst_window: Releasing XComposite overlay window %d\n", (int)wnd);
+      XCompositeReleaseOverlayWindow(dpy, wnd);
+    }
+
+  return (Window)0;
+}
+
+
+/*
+ * Unscheduling a clock id does not wait for a callback that is already
+ * running, so the callback only reaches the ClockTimeout through this
+ * table of armed ids, under the lock clock_timeout_remove() takes too.
+ */
+static GStaticMutex armed_lock = G_STATIC_MUTEX_INIT;
+static GHashTable *armed = NULL;
+
+#ifdef HAVE_MCE
+/* Set up by player_connect_system_bus(), for player_new() to take over */
+static DBusConnection *startup_system_bus = NULL;
+static gboolean startup_system_bus_tried = FALSE;
+#endif /* HAVE_MCE */
+
+/* Runs in the clock's thread */
+static gboolean
+post_eos(GstClock *clock, GstClockTime time, GstClockID id, gpointer null)
+{
+  ClockTimeout *ct = NULL;
+
+  g_static_mutex_lock(&armed_lock);
+  if (armed && (ct = g_hash_table_lookup(armed, id)) != NULL) {
+    if (ct->warning) {
+      g_warning("post_eos: FATAL: Exiting: cannot play further logos: %s", ct->warning);
+      _Exit(1);
+    }
+    if (ct->message_name)
+      gst_element_post_message(ct->pipeline,
+        gst_message_new_application(GST_OBJECT(ct->pipeline), gst_structure_empty_new(ct->message_name)));
+    else
+      gst_element_post_message(ct->pipeline, gst_message_new_eos(GST_OBJECT(ct->pipeline)));
+  }
+  g_static_mutex_unlock(&armed_lock);
+
+  return TRUE;
+}
+
+/* Once this returns, post_eos() no longer touches ct */
+static void
+clock_timeout_remove(ClockTimeout *ct)
+{
+  if (ct->id) {
+    g_static_mutex_lock(&armed_lock);
+    g_hash_table_remove(armed, ct->id);
+    g_static_mutex_unlock(&armed_lock);
+    gst_clock_id_unschedule(ct->id);
+    gst_clock_id_unref(ct->id);
+    ct->id = NULL;
+  }
+}
+
+/*
+ * Post EOS, or message_name if given, on the pipeline's bus when clock
+ * reaches time. With a warning, exit instead.
+ */
+static void
+clock_timeout_add_at(ClockTimeout *ct, GstClock *clock, GstClockTime time, GstElement *pipeline, const char *warning, const char *message_name)
+{
+  clock_timeout_remove(ct);
+  ct->pipeline = pipeline;
+  ct->warning = warning;
+  ct->message_name = message_name;
+  ct->id = gst_clock_new_single_shot_id(clock, time);
+  g_static_mutex_lock(&armed_lock);
+  if (!armed)
+    armed = g_hash_table_new(g_direct_hash, g_direct_equal);
+  g_hash_table_insert(armed, ct->id, ct);
+  g_static_mutex_unlock(&armed_lock);
+  gst_clock_id_wait_async(ct->id, (GstClockCallback)post_eos, NULL);
+}
+
+/*
+ * The same, to_ms from now on the system clock. For the watchdog, which
+ * must run before the pipeline has a clock and even if the pipeline's
+ * clock stalls.
+ */
+static void
+clock_timeout_add(ClockTimeout *ct, guint to_ms, GstElement *pipeline, const char *warning, const char *message_name)
+{
+  GstClock *clock = gst_system_clock_obtain();
+
+  clock_timeout_add_at(ct, clock, gst_clock_get_time(clock) + ((GstClockTime)to_ms) * GST_MSECOND, pipeline, warning, message_name);
+  gst_object_unref(clock);
+}
+
+#ifdef HAVE_MCE
+static void
+display_status_update(Player *player, DBusMessage *message)
+{
+  const char *status = NULL;
+
+  if (dbus_message_get_args(message, NULL, DBUS_TYPE_STRING, &status, DBUS_TYPE_INVALID)) {
+    g_debug("display_status_update: Display is %s", status);
+    player->display_on = g_str_equal(status, "on");
+  }
+}
+
+static DBusHandlerResult
+mce_signal_filter(DBusConnection *conn, DBusMessage *message, Player *player)
+{
+  if (dbus_message_is_signal(message, MCE_SIGNAL_IF, MCE_DISPLAY_SIG))
+    display_status_update(player, message);
+
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void
+display_status_reply(DBusPendingCall *call, Player *player)
+{
+  DBusMessage *reply = NULL;
+
+  if ((reply = dbus_pending_call_steal_reply(call)) != NULL) {
+    if (DBUS_MESSAGE_TYPE_METHOD_RETURN == dbus_message_get_type(reply))
+      display_status_update(player, reply);
+    dbus_message_unref(reply);
+  }
+  dbus_pending_call_unref(call);
+  player->status_call = NULL;
+}
+
+static void
+unblank_reply(DBusPendingCall *call, Player *player)
+{
+  DBusMessage *reply = NULL;
+
+  if ((reply = dbus_pending_call_steal_reply(call)) != NULL) {
+    if (DBUS_MESSAGE_TYPE_METHOD_RETURN == dbus_message_get_type(reply))
+      player->display_on = TRUE;
+    else
+      g_warning("unblank_reply: MCE failed to turn the display on: %s\n", dbus_message_get_error_name(reply));
+    dbus_message_unref(reply);
+  }
+  dbus_pending_call_unref(call);
+  player->unblank_call = NULL;
+}
+
+/* Send an MCE request whose reply is handled from the main loop */
+static DBusPendingCall *
+mce_call(Player *player, const char *method, DBusPendingCallNotifyFunction notify)
+{
+  DBusMessage *message = NULL;
+  DBusPendingCall *call = NULL;
+
+  if ((message = dbus_message_new_method_call(MCE_SERVICE, MCE_REQUEST_PATH, MCE_REQUEST_IF, method)) != NULL) {
+    if (dbus_connection_send_with_reply(player->system_bus, message, &call, MCE_CALL_TIMEOUT_MS) && call)
+      dbus_pending_call_set_notify(call, notify, player, NULL);
+    dbus_message_unref(message);
+  }
+
+  return call;
+}
+
+/*
+ * Keep one connection to the system bus, dispatched from the main loop, and
+ * track the display state so that a display which is on is left alone.
+ */
+static void
+mce_connect(Player *player)
+{
+  if (startup_system_bus_tried) {
+    player->system_bus = startup_system_bus;
+    startup_system_bus = NULL;
+  }
+  else
+    player->system_bus = dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
+
+  if (!(player->system_bus)) {
+    g_warning("mce_connect: Failed to connect to the system bus\n");
+    return;
+  }
+
+  dbus_connection_setup_with_g_main(player->system_bus, NULL);
+  dbus_connection_add_filter(player->system_bus, (DBusHandleMessageFunction)mce_signal_filter, player, NULL);
+  dbus_bus_add_match(player->system_bus, MCE_DISPLAY_SIG_MATCH, NULL);
+  player->status_call = mce_call(player, MCE_DISPLAY_STATUS_GET, (DBusPendingCallNotifyFunction)display_status_reply);
+}
+
+static void
+mce_disconnect(Player *player)
+{
+  if (!(player->system_bus)) return;
+
+  if (player->status_call) {
+    dbus_pending_call_cancel(player->status_call);
+    dbus_pending_call_unref(player->status_call);
+  }
+  if (player->unblank_call) {
+    dbus_pending_call_cancel(player->unblank_call);
+    dbus_pending_call_unref(player->unblank_call);
+  }
+  dbus_bus_remove_match(player->system_bus, MCE_DISPLAY_SIG_MATCH, NULL);
+  dbus_connection_remove_filter(player->system_bus, (DBusHandleMessageFunction)mce_signal_filter, player);
+  dbus_connection_unref(player->system_bus);
+  player->system_bus = NULL;
+}
+#endif /* HAVE_MCE */
+
+/*
+ * Connecting and saying Hello to the bus daemon blocks, so startup does it
+ * in a thread of its own ahead of player_new(), which then does not wait.
+ */
+void
+player_connect_system_bus()
+{
+#ifdef HAVE_MCE
+  gint64 start = trace_now();
+
+  dbus_threads_init_default();
+  startup_system_bus = dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
+  startup_system_bus_tried = TRUE;
+  trace_complete("dbus_bus_get", start, NULL);
+#endif /* HAVE_MCE */
+}
+
+/* Ask MCE to turn the display on, without waiting for it */
+static void
+unblank_screen(Player *player)
+{
+#ifdef HAVE_MCE
+  if (player->system_bus && !(player->display_on) && !(player->unblank_call))
+    player->unblank_call = mce_call(player, MCE_DISPLAY_ON_REQ, (DBusPendingCallNotifyFunction)unblank_reply);
+#endif /* HAVE_MCE */
+}
+
+/* The video sink chosen by player_setup_video_sink(), wrapped up for playbin2 */
+static GstElement *
+create_video_sink(Player *player)
+{
+  GstElement *sink = NULL;
+  GError *err = NULL;
+
+  if ((sink = gst_parse_bin_from_description(player->video_sink_str, TRUE, &err)) == NULL) {
+    g_warning("create_video_sink: Failed to create '%s': %s\n", player->video_sink_str, err ? err->message : "");
+    if (err)
+      g_error_free(err);
+  }
+
+  return sink;
+}
+
+/* playbin2's own playsink may have a video-sink property too, but is no pipeline */
+static gint
+playbin_compare(GstElement *element, gpointer null)
+{
+  if (GST_IS_PIPELINE(element) && g_object_class_find_property(G_OBJECT_GET_CLASS(element), "video-sink"))
+    return 0;
+
+  gst_object_unref(element);
+  return 1;
+}
+
+/*
+ * The playbin2 the default video pipeline string has created, with a new
+ * reference. Next to an engine bin, it sits in a bin of its own.
+ */
+static GstElement *
+find_playbin(GstElement *pipeline)
+{
+  GstIterator *itr = NULL;
+  GstElement *playbin = NULL;
+
+  if (g_object_class_find_property(G_OBJECT_GET_CLASS(pipeline), "video-sink"))
+    return gst_object_ref(pipeline);
+
+  if ((itr = gst_bin_iterate_recurse(GST_BIN(pipeline))) != NULL) {
+    playbin = gst_iterator_find_custom(itr, (GCompareFunc)playbin_compare, NULL);
+    gst_iterator_free(itr);
+  }
+
+  return playbin;
+}
+
+/* playbin2 has created the source element for a new URI */
+static void
+playbin_source_cb(GObject *playbin, GParamSpec *pspec, gpointer null)
+{
+  GstElement *source = NULL;
+
+  g_object_get(playbin, "source", &source, NULL);
+  if (source) {
+    engine_source_use_mmap(source);
+    gst_object_unref(source);
+  }
+}
+
+/* Runs in a streaming thread: stop at audio caps, so no audio parser or decoder is plugged */
+static gboolean
+skip_audio_cb(GstElement *decodebin, GstPad *pad, GstCaps *caps, gpointer null)
+{
+  const GstStructure *structure = NULL;
+
+  if (gst_caps_get_size(caps) > 0)
+    if ((structure = gst_caps_get_structure(caps, 0)) != NULL)
+      return !g_str_has_prefix(gst_structure_get_name(structure), "audio/");
+
+  return TRUE;
+}
+
+/* playbin2 adds a uridecodebin for each URI, gapless switches included */
+static void
+skip_audio_element_added(GstBin *playbin, GstElement *element, gpointer null)
+{
+  if (g_signal_lookup("autoplug-continue", G_OBJECT_TYPE(element)))
+    g_signal_connect(G_OBJECT(element), "autoplug-continue", (GCallback)skip_audio_cb, NULL);
+}
+
+/*
+ * Make playbin2 video-only. Without the audio flags it creates no audio
+ * sink or volume element, but its uridecodebin would still decode the
+ * audio stream, so autoplugging stops at audio caps and the stream is
+ * exposed undecoded, to be left unlinked.
+ */
+static void
+playbin_disable_audio(GstElement *playbin)
+{
+  guint flags = 0;
+
+  g_object_get(G_OBJECT(playbin), "flags", &flags, NULL);
+  g_object_set(G_OBJECT(playbin), "flags", flags & ~(PLAY_FLAG_AUDIO | PLAY_FLAG_SOFT_VOLUME | PLAY_FLAG_NATIVE_AUDIO), NULL);
+  g_signal_connect(G_OBJECT(playbin), "element-added", (GCallback)skip_audio_element_added, NULL);
+}
+
+/*
+ * Show a still image without a decoder, converter or scaler running during
+ * the logo: the engine decodes it once as the pipeline prerolls and the
+ * sink holds that frame until the logo is stopped.
+ */
+static GstElement *
+create_still(Player *player, const MediaInfo *info, int duration)
+{
+  GstElement *sink = NULL;
+
+  if ((sink = create_video_sink(player)) == NULL)
+    return NULL;
+  gst_object_set_name(GST_OBJECT(sink), VIDEO_SINK_NAME);
+
+  return engine_still_bin_new(info, sink, duration);
+}
+
+/* Add a bin built by the engine to the pipeline, creating the pipeline if need be */
+static gboolean
+add_engine_bin(GstElement **p_pipeline, GstElement *bin)
+{
+  if (!bin)
+    return FALSE;
+
+  if (!(*p_pipeline))
+    *p_pipeline = gst_pipeline_new(NULL);
+  gst_bin_add(GST_BIN(*p_pipeline), bin);
+
+  return TRUE;
+}
+
+/*
+ * Where the default pipelines are in use, the media cache knows the files
+ * and allow_engine is set, the engine builds the decoding graph directly,
+ * and *p_engine is set. Anything else is described by the configured
+ * pipeline strings.
+ */
+static GstElement *
+create_pipeline(Player *player, const char *video, const char *audio, int duration, gboolean allow_engine, gboolean *p_engine)
+{
+  GstElement* pipeline = NULL, *playbin = NULL, *sink = NULL, *bin = NULL;
+  GString *pipeline_str = g_string_new("");
+  gboolean default_video = g_str_equal(player->options.video_pipeline_str, DEFAULT_VIDEO_PIPELINE_STR);
+  gboolean explicit_audio = (allow_engine && player->media_info && g_str_equal(player->options.audio_pipeline_str, DEFAULT_AUDIO_PIPELINE_STR));
+  gboolean default_shush = g_str_equal(player->options.shush_pipeline_str, DEFAULT_SHUSH_PIPELINE_STR);
+  gboolean use_playbin = FALSE;
+  const MediaInfo *info = NULL;
+  guint flags = 0;
+  gint64 start = trace_now();
+
+  if (video && video[0]) {
+    if (default_video)
+      info = media_info_cache_lookup(player->media_info, video);
+
+    if (allow_engine && info && info->is_image)
+      bin = create_still(player, info, duration);
+    else
+    if (allow_engine && engine_can_play(info, TRUE) && (sink = create_video_sink(player)) != NULL) {
+      gst_object_set_name(GST_OBJECT(sink), VIDEO_SINK_NAME);
+      /* In the silent profile the engine builds no audio branch at all */
+      bin = engine_file_bin_new(info, sink, player->options.silent ? NULL : gst_element_factory_make("autoaudiosink", NULL));
+    }
+    if (add_engine_bin(&pipeline, bin))
+      (*p_engine) = TRUE;
+    else {
+      g_string_append_printf(pipeline_str, player->options.video_pipeline_str, video);
+      use_playbin = default_video;
+    }
+  }
+
+  if (audio && audio[0] && !(player->options.silent)) {
+    if ('s' == audio[0] && 0 == audio[1]) {
+      if (!(default_shush && add_engine_bin(&pipeline, engine_silence_bin_new())))
+        g_string_append_printf(pipeline_str, player->options.shush_pipeline_str);
+    }
+    else
+    if (explicit_audio && add_engine_bin(&pipeline, engine_file_bin_new(media_info_cache_lookup(player->media_info, audio), NULL, gst_element_factory_make("autoaudiosink", NULL))))
+      (*p_engine) = TRUE;
+    else
+      g_string_append_printf(pipeline_str, player->options.audio_pipeline_str, audio);
+  }
+
+  if (pipeline_str->len > 0) {
+    g_debug("pipeline str: %s", pipeline_str->str);
+    if (!pipeline)
+      pipeline = gst_parse_launch(pipeline_str->str, NULL);
+    else
+    if ((bin = gst_parse_bin_from_description(pipeline_str->str, FALSE, NULL)) != NULL)
+      gst_bin_add(GST_BIN(pipeline), bin);
+  }
+  g_string_free(pipeline_str, TRUE);
+  trace_complete("create_pipeline", start, (video && video[0]) ? video : audio);
+
+  /*
+   * Decoders can only allocate their output straight from the sink's shared
+   * memory if playbin2 adds no converters, which still images need.
+   */
+  if (pipeline && (use_playbin || player->options.silent))
+    if ((playbin = find_playbin(pipeline)) != NULL) {
+      if (use_playbin) {
+        g_object_set(G_OBJECT(playbin), "video-sink", create_video_sink(player), NULL);
+        g_signal_connect(G_OBJECT(playbin), "notify::source", (GCallback)playbin_source_cb, NULL);
+        if (player->native_video && info && !(info->is_image)) {
+          g_object_get(G_OBJECT(playbin), "flags", &flags, NULL);
+          g_object_set(G_OBJECT(playbin), "flags", flags | PLAY_FLAG_NATIVE_VIDEO, NULL);
+        }
+      }
+      /* The silent profile's fallback: playbin2 neither decodes nor plays the audio stream */
+      if (player->options.silent)
+        playbin_disable_audio(playbin);
+      gst_object_unref(playbin);
+    }
+
+  return pipeline;
+}
+
+/*
+ * Runs in the streaming threads of a logo's pipeline. A lookahead pipeline
+ * prerolls while the previous logo is still on screen, so its video sink
+ * must neither create a window of its own nor paint the preroll frame.
+ */
+static GstBusSyncReply
+overlay_sync_handler(GstBus *bus, GstMessage *message, Logo *logo)
+{
+  GstElement *sink = NULL;
+
+  if (GST_MESSAGE_ELEMENT == GST_MESSAGE_TYPE(message) && message->structure)
+    if (gst_structure_has_name(message->structure, "prepare-xwindow-id")) {
+      sink = GST_ELEMENT(GST_MESSAGE_SRC(message));
+      if (!(logo->started) && !(logo->video_sink))
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(sink), "show-preroll-frame")) {
+          g_object_set(G_OBJECT(sink), "show-preroll-frame", FALSE, NULL);
+          logo->video_sink = gst_object_ref(sink);
+        }
+      gst_x_overlay_set_xwindow_id(GST_X_OVERLAY(sink), logo->player->dst_window);
+      gst_message_unref(message);
+      return GST_BUS_DROP;
+    }
+
+  return GST_BUS_PASS;
+}
+
+/* Runs in the video sink's streaming thread: remember the frame on screen */
+static gboolean
+logo_last_frame_probe(GstPad *pad, GstBuffer *buffer, Logo *logo)
+{
+  GST_OBJECT_LOCK(pad);
+  gst_buffer_replace(&(logo->last_frame), buffer);
+  GST_OBJECT_UNLOCK(pad);
+
+  return TRUE;
+}
+
+static gboolean
+snapshot_done(SnapshotJob *job)
+{
+  Player *player = job->player;
+  Logo *logo = player->snapshot_logo;
+
+  g_thread_join(player->snapshot_thread);
+  player->snapshot_thread = NULL;
+  player->snapshot_job = NULL;
+  player->snapshot_logo = NULL;
+
+  /* Only repaint if no other logo is on the window by now */
+  if (logo && poster_snapshot_show(job->snapshot, player->dpy, player->dst_window, !(player->current) || logo == player->current)) {
+    logo->snapshot = TRUE;
+    if (logo == player->old) {
+      logo_free(logo);
+      player->old = NULL;
+    }
+  }
+
+  poster_snapshot_free(job->snapshot);
+  g_free(job);
+
+  return FALSE;
+}
+
+static gpointer
+snapshot_convert_thread(SnapshotJob *job)
+{
+  gint64 start = trace_now();
+
+  poster_snapshot_convert(job->snapshot);
+  trace_complete("snapshot", start, NULL);
+  g_idle_add((GSourceFunc)snapshot_done, job);
+
+  return NULL;
+}
+
+/*
+ * Leave the last frame on the window, so that the pipeline can be freed.
+ * The conversion runs in a thread of its own, one logo at a time, so that
+ * it stays out of the gap between logos.
+ */
+static void
+logo_snapshot(Logo *logo)
+{
+  Player *player = logo->player;
+  SnapshotJob *job = NULL;
+  GstBuffer *frame = NULL;
+
+  if (!(logo->frame_pad) || player->snapshot_thread) return;
+
+  GST_OBJECT_LOCK(logo->frame_pad);
+  frame = logo->last_frame;
+  logo->last_frame = NULL;
+  GST_OBJECT_UNLOCK(logo->frame_pad);
+
+  if (frame) {
+    if ((job = g_new0(SnapshotJob, 1)) != NULL) {
+      job->player = player;
+      if ((job->snapshot = poster_snapshot_new(player->dpy, player->dst_window, frame)) != NULL &&
+          (player->snapshot_thread = g_thread_create((GThreadFunc)snapshot_convert_thread, job, TRUE, NULL)) != NULL) {
+        player->snapshot_job = job;
+        player->snapshot_logo = logo;
+      }
+      else {
+        poster_snapshot_free(job->snapshot);
+        g_free(job);
+      }
+    }
+    gst_buffer_unref(frame);
+  }
+}
+
+/* The logo has posted EOS or an error: freeze it and move on if it was on screen */
+static void
+logo_finish(Logo *logo)
+{
+  if (logo->finished) return;
+  logo->finished = TRUE;
+
+  gst_element_set_state(logo->pipeline, GST_STATE_PAUSED);
+  clock_timeout_remove(&(logo->kill_to));
+  clock_timeout_remove(&(logo->play_to));
+  if (logo->play_start)
+    trace_complete("play", logo->play_start, logo->name);
+
+  if (logo == logo->player->current) {
+    player_schedule_advance(logo->player);
+    if (logo->player->options.snapshot && logo->player->dst_window)
+      logo_snapshot(logo);
+  }
+}
+
+/*
+ * End the logo, with EOS or message_name, when the running time reaches
+ * its duration past start on the pipeline clock. The base time is set as
+ * the pipeline goes to PLAYING. The pipeline is not seeked for a segment
+ * stop: a non-flushing seek can block on the stream lock of a prerolled
+ * demuxer, and a flushing one prerolls the logo again.
+ */
+static void
+logo_arm_play_to(Logo *logo, GstClockTime start, const char *message_name)
+{
+  GstClock *clock = NULL;
+
+  if (GST_CLOCK_TIME_IS_VALID(start) && (clock = gst_pipeline_get_clock(GST_PIPELINE(logo->pipeline))) != NULL) {
+    clock_timeout_add_at(&(logo->play_to), clock,
+                         gst_element_get_base_time(logo->pipeline) + start + ((GstClockTime)(logo->duration)) * GST_MSECOND,
+                         logo->pipeline, NULL, message_name);
+    gst_object_unref(clock);
+  }
+  else
+    clock_timeout_add(&(logo->play_to), logo->duration, logo->pipeline, NULL, message_name);
+}
+
+/* Set the prerolled logo going once it is on screen */
+static void
+logo_go(Logo *logo)
+{
+  if (logo->playing || logo->finished) return;
+  logo->playing = TRUE;
+
+  gst_element_set_state(logo->pipeline, GST_STATE_PLAYING);
+  if (logo->duration > 0)
+    logo_arm_play_to(logo, 0, NULL);
+}
+
+static gboolean
+logo_bus_cb(GstBus *bus, GstMessage *message, Logo *logo)
+{
+  GError *err = NULL;
+  char *debug = NULL;
+  Player *player = logo->player;
+
+  switch(GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_ASYNC_DONE:
+      g_debug("logo_bus_cb: Ready to play: duration = %d\n", logo->duration);
+      if (logo->preroll_start) {
+        trace_complete("preroll", logo->preroll_start, logo->name);
+        logo->preroll_start = 0;
+      }
+      logo->prerolled = TRUE;
+      if (logo->started)
+        logo_go(logo);
+      break;
+
+    case GST_MESSAGE_ERROR:
+      gst_message_parse_error(message, &err, &debug);
+      g_warning("logo_bus_cb: %s: %s %s\n", GST_MESSAGE_TYPE_NAME(message), err ? err->message : "", debug ? debug : "");
+      if (err)
+        g_error_free(err);
+      g_free(debug);
+      if (logo_fall_back(logo))
+        break;
+      logo->failed = TRUE;
+      /* fall through */
+    case GST_MESSAGE_EOS:
+      g_debug("logo_bus_cb: Gst message: %s", GST_MESSAGE_TYPE_NAME(message));
+      trace_instant(GST_MESSAGE_EOS == GST_MESSAGE_TYPE(message) ? "eos" : "error", logo->name);
+      if (logo->started)
+        logo_finish(logo);
+      break;
+
+    case GST_MESSAGE_ELEMENT:
+      if (gst_structure_has_name(message->structure, "prepare-xwindow-id")) {
+        if (0 == player->dst_window)
+          player->dst_window = get_dst_window(player->dpy);
+        if (player->dst_window)
+          gst_x_overlay_set_xwindow_id(GST_X_OVERLAY(GST_MESSAGE_SRC(message)), player->dst_window);
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Runs in the video sink's streaming thread. A frame that arrives while a
+ * lookahead logo prerolls is only shown once the logo starts.
+ */
+static gboolean
+logo_first_frame_probe(GstPad *pad, GstBuffer *buffer, Logo *logo)
+{
+  if (logo->started)
+    trace_instant("first-frame", logo->name);
+  else
+    logo->frame_ready = TRUE;
+
+  gst_pad_remove_buffer_probe(pad, logo->frame_probe_id);
+  logo->frame_probe_id = 0;
+
+  return TRUE;
+}
+
+/* Watch for the first frame reaching the logo's video sink, if it has one */
+static void
+logo_trace_first_frame(Logo *logo, GstElement *sink)
+{
+  GstElement *playbin = NULL;
+
+  if (sink)
+    gst_object_ref(sink);
+  else
+  if ((sink = gst_bin_get_by_name(GST_BIN(logo->pipeline), VIDEO_SINK_NAME)) == NULL)
+    if ((playbin = find_playbin(logo->pipeline)) != NULL) {
+      g_object_get(G_OBJECT(playbin), "video-sink", &sink, NULL);
+      gst_object_unref(playbin);
+    }
+
+  if (sink) {
+    if ((logo->frame_pad = gst_element_get_static_pad(sink, "sink")) != NULL)
+      logo->frame_probe_id = gst_pad_add_buffer_probe(logo->frame_pad, (GCallback)logo_first_frame_probe, logo);
+    gst_object_unref(sink);
+  }
+}
+
+/* Watch the logo's pipeline: its first frame, its bus and, with lookahead, its overlay */
+static void
+logo_attach(Logo *logo, GstElement *pipeline)
+{
+  Player *player = logo->player;
+  GstBus *bus = NULL;
+
+  logo->pipeline = pipeline;
+  logo_trace_first_frame(logo, NULL);
+  if (player->options.snapshot && logo->frame_pad)
+    logo->last_frame_probe_id = gst_pad_add_buffer_probe(logo->frame_pad, (GCallback)logo_last_frame_probe, logo);
+  if ((bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline))) != NULL) {
+    if (player->options.lookahead && player->dst_window)
+      gst_bus_set_sync_handler(bus, (GstBusSyncHandler)overlay_sync_handler, logo);
+    logo->bus_watch_id = gst_bus_add_watch(bus, (GstBusFunc)logo_bus_cb, logo);
+    gst_object_unref(bus);
+  }
+}
+
+static Logo *
+logo_new(Player *player, const char *video, const char *audio, int duration)
+{
+  Logo *logo = NULL;
+  GstElement *pipeline = NULL;
+  gboolean engine = FALSE;
+
+  g_debug("logo_new: (video = '%s', audio = '%s', duration = '%d')", video, audio, duration);
+  readahead_note(video);
+  readahead_note(audio);
+
+  if ((pipeline = create_pipeline(player, video, audio, duration, TRUE, &engine)) != NULL) {
+    if ((logo = g_new0(Logo, 1)) != NULL) {
+      logo->player = player;
+      logo->duration = duration;
+      logo->video = g_strdup(video);
+      logo->audio = g_strdup(audio);
+      logo->engine = engine;
+      logo->name = g_strdup((video && video[0]) ? video : audio);
+      logo_attach(logo, pipeline);
+    }
+    else
+      gst_object_unref(pipeline);
+  }
+
+  return logo;
+}
+
+/*
+ * Take the next playlist entry whose media was found, with the video for the
+ * window. An entry whose sound is missing still shows its video.
+ */
+static const PlaylistEntry *
+player_next_entry(Player *player, const char **p_video, const char **p_audio)
+{
+  const PlaylistEntry *entry = NULL;
+  guint idx;
+
+  while ((entry = playlist_get_entry(player->playlist, (idx = player->next_entry))) != NULL) {
+    player->next_entry++;
+    if (PLAYLIST_ENTRY_PLAYABLE(entry)) {
+      (*p_video) = playlist_get_video(player->playlist, idx);
+      (*p_audio) = (entry->status & PLAYLIST_ENTRY_MISSING_AUDIO) ? NULL : entry->audio;
+      return entry;
+    }
+    g_warning("player_next_entry: Skipping logo %u, its media is missing\n", idx + 1);
+  }
+
+  return NULL;
+}
+
+/* Return the next logo in the playlist that yields a usable pipeline */
+static Logo *
+logo_read_next(Player *player)
+{
+  const PlaylistEntry *entry = NULL;
+  const char *video = NULL, *audio = NULL;
+  Logo *logo = NULL;
+
+  while (!logo && (entry = player_next_entry(player, &video, &audio)) != NULL)
+    logo = logo_new(player, video, audio, entry->duration);
+
+  return logo;
+}
+
+/* Bring the logo to PAUSED in the background, ready to start on cue */
+static Logo *
+logo_preroll(Logo *logo)
+{
+  if (logo) {
+    g_debug("logo_preroll: prerolling next logo");
+    logo->preroll_start = trace_now();
+    gst_element_set_state(logo->pipeline, GST_STATE_PAUSED);
+  }
+
+  return logo;
+}
+
+static void
+play_logo(Logo *logo)
+{
+  g_debug("play_logo: playing (duration = '%d')", logo->duration);
+
+  logo->started = TRUE;
+  logo->player->n_started++;
+  logo->play_start = trace_now();
+  if (!(logo->prerolled || logo->preroll_start))
+    logo->preroll_start = logo->play_start;
+  if (logo->video_sink)
+    g_object_set(G_OBJECT(logo->video_sink), "show-preroll-frame", TRUE, NULL);
+  if (logo->frame_ready)
+    trace_instant("first-frame", logo->name);
+
+  clock_timeout_add(&(logo->kill_to), KILL_TO_LENGTH_MS, logo->pipeline, "Absolute timeout reached!\n", NULL);
+
+  /* Otherwise it starts when it has prerolled and knows where to stop */
+  if (logo->prerolled)
+    logo_go(logo);
+  else
+    gst_element_set_state(logo->pipeline, GST_STATE_PAUSED);
+  unblank_screen(logo->player);
+}
+
+/* Runs once the pipeline is down, when no probe or sync handler can be running */
+static void
+logo_release(Logo *logo)
+{
+  if (logo->frame_pad)
+    gst_object_unref(logo->frame_pad);
+  if (logo->last_frame)
+    gst_buffer_unref(logo->last_frame);
+  if (logo->video_sink)
+    gst_object_unref(logo->video_sink);
+  g_free(logo->name);
+  g_free(logo->video);
+  g_free(logo->audio);
+  g_free(logo);
+}
+
+/* Disconnect the logo from its pipeline, whose streaming threads may still be in its callbacks */
+static void
+logo_detach(Logo *logo)
+{
+  GstBus *bus = NULL;
+
+  if (logo->bus_watch_id)
+    g_source_remove(logo->bus_watch_id);
+  if ((bus = gst_pipeline_get_bus(GST_PIPELINE(logo->pipeline))) != NULL) {
+    gst_bus_set_sync_handler(bus, NULL, NULL);
+    gst_object_unref(bus);
+  }
+  clock_timeout_remove(&(logo->kill_to));
+  clock_timeout_remove(&(logo->play_to));
+  if (logo->frame_pad) {
+    if (logo->frame_probe_id)
+      gst_pad_remove_buffer_probe(logo->frame_pad, logo->frame_probe_id);
+    if (logo->last_frame_probe_id)
+      gst_pad_remove_buffer_probe(logo->frame_pad, logo->last_frame_probe_id);
+  }
+}
+
+/* Hand the logo to the reaper, which frees it once its pipeline is torn down */
+static void
+logo_free(Logo *logo)
+{
+  gint64 start = trace_now();
+
+  if (!logo) return;
+  if (logo == logo->player->snapshot_logo)
+    logo->player->snapshot_logo = NULL;
+  logo_detach(logo);
+  trace_complete("logo_free", start, logo->name);
+  reaper_reap(logo->pipeline, logo->name, (GDestroyNotify)logo_release, logo);
+}
+
+/*
+ * The engine's graph failed before prerolling, so the media cache may be
+ * wrong about the files: swap in a pipeline from the pipeline strings,
+ * playbin2 for the default one. Tried once per logo.
+ */
+static gboolean
+logo_fall_back(Logo *logo)
+{
+  GstElement *pipeline = NULL;
+  gboolean engine = FALSE;
+
+  if (!(logo->engine) || logo->prerolled)
+    return FALSE;
+  logo->engine = FALSE;
+
+  if ((pipeline = create_pipeline(logo->player, logo->video, logo->audio, logo->duration, FALSE, &engine)) == NULL)
+    return FALSE;
+
+  g_debug("logo_fall_back: Playing %s without the engine", logo->name);
+  trace_instant("fall-back", logo->name);
+
+  logo_detach(logo);
+  reaper_reap(logo->pipeline, logo->name, NULL, NULL);
+  if (logo->frame_pad) {
+    gst_object_unref(logo->frame_pad);
+    logo->frame_pad = NULL;
+  }
+  logo->frame_probe_id = 0;
+  logo->last_frame_probe_id = 0;
+  logo->bus_watch_id = 0;
+  if (logo->video_sink) {
+    gst_object_unref(logo->video_sink);
+    logo->video_sink = NULL;
+  }
+  logo->frame_ready = FALSE;
+
+  logo_attach(logo, pipeline);
+  if (logo->started)
+    clock_timeout_add(&(logo->kill_to), KILL_TO_LENGTH_MS, pipeline, "Absolute timeout reached!\n", NULL);
+  if (logo->started || logo->preroll_start)
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+
+  return TRUE;
+}
+
+static gboolean
+player_preload(Player *player)
+{
+  player->preload_id = 0;
+  if (!(player->next))
+    player->next = logo_preroll(logo_read_next(player));
+
+  return FALSE;
+}
+
+/* Start the next logo, or finish if there is none */
+static gboolean
+player_advance(Player *player)
+{
+  Logo *logo = NULL, *old_logo = NULL;
+
+  player->advance_id = 0;
+  if (player->preload_id) {
+    g_source_remove(player->preload_id);
+    player->preload_id = 0;
+  }
+
+  logo = player->next;
+  player->next = NULL;
+  if (logo && logo->failed) {
+    logo_free(logo);
+    logo = NULL;
+  }
+  if (!logo)
+    logo = logo_read_next(player);
+
+  /* Keep the previous logo around until its successor has finished */
+  old_logo = player->old;
+  player->old = player->current;
+  player->current = logo;
+
+  /* Unless the window holds on to its last frame: then only one pipeline is alive at a time */
+  if (player->old && player->old->snapshot) {
+    logo_free(player->old);
+    player->old = NULL;
+  }
+
+  if (logo) {
+    play_logo(logo);
+    if (player->options.lookahead)
+      player->preload_id = g_idle_add((GSourceFunc)player_preload, player);
+  }
+
+  logo_free(old_logo);
+
+  if (!logo)
+    player_finish(player);
+
+  return FALSE;
+}
+
+static void
+player_schedule_advance(Player *player)
+{
+  if (0 == player->advance_id && PLAYER_STATE_PLAYING == player->state)
+    player->advance_id = g_idle_add_full(G_PRIORITY_HIGH, (GSourceFunc)player_advance, player, NULL);
+}
+
+static void
+player_finish(Player *player)
+{
+  g_debug("player_finish: No more logos");
+  player->state = PLAYER_STATE_FINISHED;
+  if (player->done)
+    player->done(player->done_data);
+}
+
+static void
+persistent_entry_free(PersistentEntry *entry)
+{
+  if (!entry) return;
+  g_free(entry->uri);
+  g_free(entry->audio);
+  g_free(entry);
+}
+
+/* Return the next entry that has a video for playbin2 to play */
+static PersistentEntry *
+persistent_entry_read(Player *player)
+{
+  PersistentEntry *entry = NULL;
+  const PlaylistEntry *source = NULL;
+  const char *video = NULL, *audio = NULL;
+
+  while (!entry && (source = player_next_entry(player, &video, &audio)) != NULL) {
+    if (video && video[0]) {
+      readahead_note(video);
+      if ((entry = g_new0(PersistentEntry, 1)) != NULL) {
+        entry->uri = g_strdup_printf("file://%s", video);
+        entry->audio = g_strdup(audio);
+        entry->duration = source->duration;
+      }
+    }
+    else
+      g_warning("persistent_entry_read: Skipping entry without a video\n");
+  }
+
+  return entry;
+}
+
+/* Runs in a streaming thread when playbin2 needs the next URI */
+static void
+persistent_about_to_finish(GstElement *playbin, PersistentPlayer *pp)
+{
+  g_mutex_lock(pp->lock);
+  if (pp->next && !(pp->next_queued)) {
+    g_debug("persistent_about_to_finish: Queueing %s", pp->next->uri);
+    g_object_set(G_OBJECT(playbin), "uri", pp->next->uri, NULL);
+    pp->next_queued = TRUE;
+    g_atomic_int_set(&(pp->switch_pending), 1);
+  }
+  g_mutex_unlock(pp->lock);
+}
+
+/*
+ * The first new segment reaching the video sink after a queued URI marks
+ * the logo boundary. The sink has rendered the last frame of the previous
+ * logo by then, so the running time it is reached at is where the new logo
+ * starts.
+ */
+static gboolean
+persistent_segment_probe(GstPad *pad, GstEvent *event, PersistentPlayer *pp)
+{
+  GstElement *pipeline = pp->logo->pipeline;
+  GstClock *clock = NULL;
+  GstClockTime running_time = GST_CLOCK_TIME_NONE;
+
+  if (GST_EVENT_NEWSEGMENT == GST_EVENT_TYPE(event))
+    if (g_atomic_int_compare_and_exchange(&(pp->switch_pending), 1, 0)) {
+      if ((clock = gst_element_get_clock(pipeline)) != NULL) {
+        running_time = gst_clock_get_time(clock) - gst_element_get_base_time(pipeline);
+        gst_object_unref(clock);
+      }
+      gst_element_post_message(pipeline,
+        gst_message_new_application(GST_OBJECT(pipeline),
+          gst_structure_new(LOGO_STARTED_MESSAGE, "running-time", G_TYPE_UINT64, running_time, NULL)));
+    }
+
+  return TRUE;
+}
+
+/* pp->next has just become the logo on screen */
+static void
+persistent_advance(Player *player)
+{
+  PersistentPlayer *pp = player->pp;
+  PersistentEntry *entry = NULL;
+
+  g_mutex_lock(pp->lock);
+  persistent_entry_free(pp->current);
+  pp->current = pp->next;
+  pp->next = NULL;
+  pp->next_queued = FALSE;
+  g_mutex_unlock(pp->lock);
+
+  player->n_started++;
+  g_debug("persistent_advance: Now playing %s", pp->current->uri);
+  trace_instant("logo-started", pp->current->uri);
+
+  clock_timeout_add(&(pp->logo->kill_to), KILL_TO_LENGTH_MS, pp->logo->pipeline, "Absolute timeout reached!\n", NULL);
+  pp->logo->duration = pp->current->duration;
+  clock_timeout_remove(&(pp->logo->play_to));
+
+  /* Prerolled here, started with the video by persistent_playing() */
+  logo_free(pp->sound);
+  pp->sound = NULL;
+  if (pp->current->audio && pp->current->audio[0])
+    if ((pp->sound = logo_new(player, NULL, pp->current->audio, 0)) != NULL)
+      gst_element_set_state(pp->sound->pipeline, GST_STATE_PAUSED);
+
+  entry = persistent_entry_read(player);
+  g_mutex_lock(pp->lock);
+  pp->next = entry;
+  g_mutex_unlock(pp->lock);
+}
+
+/*
+ * pp->current is playing since running time start: time it on the pipeline
+ * clock and start its sound. Called on a gapless switch, and once playbin2
+ * reaches PLAYING after a (re)start, from running time 0.
+ */
+static void
+persistent_playing(Player *player, GstClockTime start)
+{
+  PersistentPlayer *pp = player->pp;
+
+  pp->start_pending = FALSE;
+  if (pp->logo->duration > 0)
+    logo_arm_play_to(pp->logo, start, LOGO_CUT_MESSAGE);
+  if (pp->sound)
+    gst_element_set_state(pp->sound->pipeline, GST_STATE_PLAYING);
+}
+
+/*
+ * Stop the current logo early and restart the playbin with the next URI.
+ * The sinks are kept across the READY state. Returns FALSE if there is
+ * nothing left to play.
+ */
+static gboolean
+persistent_cut(PersistentPlayer *pp)
+{
+  GstBus *bus = NULL;
+  char *uri = NULL;
+
+  g_mutex_lock(pp->lock);
+  if (pp->next)
+    uri = g_strdup(pp->next->uri);
+  g_mutex_unlock(pp->lock);
+
+  if (uri) {
+    gst_element_set_state(pp->logo->pipeline, GST_STATE_READY);
+    g_atomic_int_set(&(pp->switch_pending), 0);
+    /* Whatever the old URI still had queued up, errors included, is of no interest */
+    if ((bus = gst_pipeline_get_bus(GST_PIPELINE(pp->logo->pipeline))) != NULL) {
+      gst_bus_set_flushing(bus, TRUE);
+      gst_bus_set_flushing(bus, FALSE);
+      gst_object_unref(bus);
+    }
+    g_object_set(G_OBJECT(pp->logo->pipeline), "uri", uri, NULL);
+    pp->start_pending = TRUE;
+    gst_element_set_state(pp->logo->pipeline, GST_STATE_PLAYING);
+    g_free(uri);
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*
+ * After an error: once about-to-finish has queued the next URI, that is
+ * the one that failed, so the entry after it is read in its place.
+ */
+static void
+persistent_drop_queued(Player *player)
+{
+  PersistentPlayer *pp = player->pp;
+  PersistentEntry *entry = NULL;
+
+  g_mutex_lock(pp->lock);
+  if (pp->next_queued) {
+    entry = pp->next;
+    pp->next = NULL;
+    pp->next_queued = FALSE;
+  }
+  g_mutex_unlock(pp->lock);
+
+  if (!entry)
+    return;
+
+  g_warning("persistent_drop_queued: Skipping %s\n", entry->uri);
+  persistent_entry_free(entry);
+
+  entry = persistent_entry_read(player);
+  g_mutex_lock(pp->lock);
+  pp->next = entry;
+  g_mutex_unlock(pp->lock);
+}
+
+static void
+persistent_stop(Player *player)
+{
+  PersistentPlayer *pp = player->pp;
+
+  gst_element_set_state(pp->logo->pipeline, GST_STATE_PAUSED);
+  clock_timeout_remove(&(pp->logo->kill_to));
+  clock_timeout_remove(&(pp->logo->play_to));
+  player_finish(player);
+}
+
+static gboolean
+persistent_bus_cb(GstBus *bus, GstMessage *message, Player *player)
+{
+  GError *err = NULL;
+  char *debug = NULL;
+  PersistentPlayer *pp = player->pp;
+  GstState state = GST_STATE_VOID_PENDING;
+  GstClockTime running_time = 0;
+
+  if (PLAYER_STATE_PLAYING != player->state)
+    return TRUE;
+
+  switch(GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_STATE_CHANGED:
+      /* Prerolled and running after a (re)start */
+      if (pp->start_pending && GST_MESSAGE_SRC(message) == GST_OBJECT(pp->logo->pipeline)) {
+        gst_message_parse_state_changed(message, NULL, &state, NULL);
+        if (GST_STATE_PLAYING == state)
+          persistent_playing(player, 0);
+      }
+      break;
+
+    case GST_MESSAGE_APPLICATION:
+      if (gst_structure_has_name(message->structure, LOGO_STARTED_MESSAGE)) {
+        if (!gst_structure_get_clock_time(message->structure, "running-time", &running_time))
+          running_time = GST_CLOCK_TIME_NONE;
+        persistent_advance(player);
+        persistent_playing(player, running_time);
+      }
+      else
+      if (gst_structure_has_name(message->structure, LOGO_CUT_MESSAGE)) {
+        g_debug("persistent_bus_cb: Duration of %s reached", pp->current->uri);
+        if (persistent_cut(pp))
+          persistent_advance(player);
+        else
+          persistent_stop(player);
+      }
+      break;
+
+    case GST_MESSAGE_ERROR:
+      gst_message_parse_error(message, &err, &debug);
+      g_warning("persistent_bus_cb: %s: %s %s\n", GST_MESSAGE_TYPE_NAME(message), err ? err->message : "", debug ? debug : "");
+      if (err)
+        g_error_free(err);
+      g_free(debug);
+      trace_instant("error", pp->current->uri);
+      /* One bad entry only ends itself */
+      persistent_drop_queued(player);
+      if (persistent_cut(pp))
+        persistent_advance(player);
+      else
+        persistent_stop(player);
+      break;
+
+    case GST_MESSAGE_EOS:
+      g_debug("persistent_bus_cb: Gst message: %s", GST_MESSAGE_TYPE_NAME(message));
+      trace_instant("eos", pp->current->uri);
+      persistent_stop(player);
+      break;
+
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Play all logos through a single playbin2 whose sinks are created once,
+ * handing it each following URI from its about-to-finish signal.
+ */
+static gboolean
+persistent_start(Player *player)
+{
+  PersistentPlayer *pp = NULL;
+  GstElement *audio_sink = NULL;
+  GstBus *bus = NULL;
+  GstPad *pad = NULL;
+
+  player->advance_id = 0;
+
+  if ((pp = player->pp = g_new0(PersistentPlayer, 1)) == NULL) {
+    player_finish(player);
+    return FALSE;
+  }
+
+  if ((pp->next = persistent_entry_read(player)) == NULL) {
+    player_finish(player);
+    return FALSE;
+  }
+
+  pp->lock = g_mutex_new();
+  if ((pp->logo = g_new0(Logo, 1)) != NULL)
+    if ((pp->logo->pipeline = gst_element_factory_make("playbin2", NULL)) == NULL) {
+      g_free(pp->logo);
+      pp->logo = NULL;
+    }
+  if (!(pp->logo)) {
+    g_warning("persistent_start: Failed to create playbin2\n");
+    player_finish(player);
+    return FALSE;
+  }
+  pp->logo->player = player;
+  pp->logo->started = TRUE;
+
+  if ((bus = gst_pipeline_get_bus(GST_PIPELINE(pp->logo->pipeline))) != NULL) {
+    if (player->dst_window)
+      gst_bus_set_sync_handler(bus, (GstBusSyncHandler)overlay_sync_handler, pp->logo);
+    pp->logo->bus_watch_id = gst_bus_add_watch(bus, (GstBusFunc)persistent_bus_cb, player);
+    gst_object_unref(bus);
+  }
+
+  if (player->options.silent)
+    playbin_disable_audio(pp->logo->pipeline);
+  else
+  if ((audio_sink = gst_element_factory_make("autoaudiosink", NULL)) != NULL)
+    g_object_set(G_OBJECT(pp->logo->pipeline), "audio-sink", audio_sink, NULL);
+  if ((pp->video_sink = create_video_sink(player)) != NULL) {
+    gst_object_ref(pp->video_sink);
+    if ((pad = gst_element_get_static_pad(pp->video_sink, "sink")) != NULL) {
+      pp->probe_id = gst_pad_add_event_probe(pad, (GCallback)persistent_segment_probe, pp);
+      gst_object_unref(pad);
+    }
+    g_object_set(G_OBJECT(pp->logo->pipeline), "video-sink", pp->video_sink, NULL);
+    logo_trace_first_frame(pp->logo, pp->video_sink);
+  }
+  g_signal_connect(G_OBJECT(pp->logo->pipeline), "about-to-finish", (GCallback)persistent_about_to_finish, pp);
+  g_signal_connect(G_OBJECT(pp->logo->pipeline), "notify::source", (GCallback)playbin_source_cb, NULL);
+
+  g_object_set(G_OBJECT(pp->logo->pipeline), "uri", pp->next->uri, NULL);
+  pp->start_pending = TRUE;
+  persistent_advance(player);
+  gst_element_set_state(pp->logo->pipeline, GST_STATE_PLAYING);
+  unblank_screen(player);
+
+  return FALSE;
+}
+
+/* Runs once playbin2 is down, when neither about-to-finish nor the probe can be running */
+static void
+persistent_release(PersistentPlayer *pp)
+{
+  if (pp->logo)
+    logo_release(pp->logo);
+  persistent_entry_free(pp->current);
+  persistent_entry_free(pp->next);
+  if (pp->lock)
+    g_mutex_free(pp->lock);
+  g_free(pp);
+}
+
+static void
+persistent_free(PersistentPlayer *pp)
+{
+  GstPad *pad = NULL;
+
+  if (!pp) return;
+  if (pp->logo)
+    g_signal_handlers_disconnect_by_func(G_OBJECT(pp->logo->pipeline), (gpointer)persistent_about_to_finish, pp);
+  if (pp->video_sink) {
+    if (pp->probe_id && (pad = gst_element_get_static_pad(pp->video_sink, "sink")) != NULL) {
+      gst_pad_remove_event_probe(pad, pp->probe_id);
+      gst_object_unref(pad);
+    }
+    gst_object_unref(pp->video_sink);
+  }
+  logo_free(pp->sound);
+  if (pp->logo) {
+    logo_detach(pp->logo);
+    reaper_reap(pp->logo->pipeline, pp->logo->name, (GDestroyNotify)persistent_release, pp);
+  }
+  else
+    persistent_release(pp);
+}
+
+static void
+get_window_geometry(Display *dpy, Window wnd, int *p_x, int *p_y, unsigned int *p_cx, unsigned int *p_cy)
+{
+  Window root_window;
+  unsigned int cx_border, depth;
+
+  if (!XGetGeometry(dpy, wnd, &root_window, p_x, p_y, p_cx, p_cy, &cx_border, &depth)) {
+    (*p_x)  =   0; (*p_y)  =   0;
+    (*p_cx) = 800; (*p_cy) = 480;
+  }
+}
+
+/* Paint a black filled rectangle over the given window */
+static void
+draw_black(Display *dpy, Window wnd)
+{
+  XGCValues vals;
+  int x, y;
+  unsigned int cx, cy;
+
+  get_window_geometry(dpy, wnd, &x, &y, &cx, &cy);
+
+  vals.foreground = BlackPixel(dpy, 0);
+  vals.background = BlackPixel(dpy, 0);
+  GC gc = XCreateGC(dpy, wnd, GCForeground | GCBackground, &vals);
+  XFillRectangle(dpy, wnd, gc, x, y, cx, cy);
+  XFreeGC(dpy, gc);
+  /* Replaces any snapshot, which would come back on the next expose */
+  XSetWindowBackground(dpy, wnd, BlackPixel(dpy, 0));
+  XFlush(dpy);
+}
+
+/*
+ * Whether the sink is installed and gets to READY, where it opens the
+ * display: xvimagesink fails there on servers without XVideo adaptors.
+ */
+static gboolean
+sink_opens_display(const char *factory_name)
+{
+  GstElement *sink = NULL;
+  gboolean ret = FALSE;
+
+  if ((sink = gst_element_factory_make(factory_name, NULL)) != NULL) {
+    ret = (GST_STATE_CHANGE_SUCCESS == gst_element_set_state(sink, GST_STATE_READY));
+    gst_element_set_state(sink, GST_STATE_NULL);
+    gst_object_unref(sink);
+  }
+
+  if (!ret)
+    g_debug("sink_opens_display: %s is unusable", factory_name);
+
+  return ret;
+}
+
+/* The factory of the best sink the display takes. Opens extra X connections. */
+static const char *
+video_sink_probe(Display *dpy)
+{
+  if (!XShmQueryExtension(dpy))
+    return AUTO_VIDEO_SINK;
+  if (sink_opens_display("xvimagesink"))
+    return "xvimagesink";
+  if (sink_opens_display("ximagesink"))
+    return "ximagesink";
+  return AUTO_VIDEO_SINK;
+}
+
+/*
+ * Probe the sinks once, ahead of the boots that use the result, so that
+ * no extra X connection or XVideo query is made on the way to the first
+ * logo. The choice goes to cache_file, or to the system cache if NULL.
+ */
+gboolean
+player_video_sink_cache_update(Display *dpy, const char *cache_file)
+{
+  const char *factory_name = video_sink_probe(dpy);
+  char *dir = NULL;
+  gboolean ret = FALSE;
+
+  if (!cache_file)
+    cache_file = VIDEO_SINK_CACHE_FILE;
+
+  dir = g_path_get_dirname(cache_file);
+  if (g_mkdir_with_parents(dir, 0755) == 0 &&
+      g_file_set_contents(cache_file, factory_name, -1, NULL)) {
+    g_debug("player_video_sink_cache_update: Using %s", factory_name);
+    ret = TRUE;
+  }
+  else
+    g_warning("player_video_sink_cache_update: Failed to write %s\n", cache_file);
+
+  g_free(dir);
+
+  return ret;
+}
+
+/* The factory player_video_sink_cache_update() chose, or NULL */
+static char *
+video_sink_cached(const char *cache_file)
+{
+  char *factory_name = NULL;
+
+  if (!g_file_get_contents(cache_file ? cache_file : VIDEO_SINK_CACHE_FILE, &factory_name, NULL, NULL))
+    return NULL;
+
+  g_strstrip(factory_name);
+  if (!(g_str_equal(factory_name, "xvimagesink") ||
+        g_str_equal(factory_name, "ximagesink") ||
+        g_str_equal(factory_name, AUTO_VIDEO_SINK))) {
+    g_free(factory_name);
+    return NULL;
+  }
+
+  return factory_name;
+}
+
+/*
+ * Render into MIT-SHM images shared with the X server. Both X sinks keep a
+ * pool of them and reuse it frame after frame, so no XImage is allocated
+ * and no pixels go through the socket. xvimagesink scales to the window in
+ * hardware and lets decoders write into its images directly; ximagesink
+ * gets frames scaled to the window geometry instead. Without an XVideo
+ * adaptor or either sink, autovideosink picks what it can. The sinks are
+ * only probed here if --update-cache has not recorded a choice.
+ */
+static void
+player_setup_video_sink(Player *player)
+{
+  Window wnd = player->dst_window ? player->dst_window : DefaultRootWindow(player->dpy);
+  char *factory_name = NULL;
+  int x, y;
+  unsigned int cx, cy;
+
+  if ((factory_name = video_sink_cached(player->options.video_sink_cache_file)) == NULL) {
+    g_debug("player_setup_video_sink: No recorded video sink, probing");
+    factory_name = g_strdup(video_sink_probe(player->dpy));
+  }
+
+  if (g_str_equal(factory_name, "xvimagesink")) {
+    player->video_sink_str = g_strdup(XV_VIDEO_SINK);
+    player->native_video = TRUE;
+  }
+  else
+  if (g_str_equal(factory_name, "ximagesink")) {
+    get_window_geometry(player->dpy, wnd, &x, &y, &cx, &cy);
+    player->video_sink_str = g_strdup_printf("video/x-raw-rgb,width=%u,height=%u ! " X_VIDEO_SINK, cx, cy);
+  }
+  else
+    player->video_sink_str = g_strdup(AUTO_VIDEO_SINK);
+  g_free(factory_name);
+
+  g_debug("player_setup_video_sink: Video sink: %s", player->video_sink_str);
+}
+
+/* Have the configuration pick the videos encoded for the window, so that they need no scaling */
+static void
+player_select_variants(Player *player)
+{
+  Window wnd = player->dst_window ? player->dst_window : DefaultRootWindow(player->dpy);
+  int x, y;
+  unsigned int cx, cy;
+
+  get_window_geometry(player->dpy, wnd, &x, &y, &cx, &cy);
+  playlist_set_resolution(player->playlist, cx, cy);
+}
+
+/* dst_window, if not 0, is an overlay window from get_dst_window() that the player takes over */
+Player *
+player_new(Display *dpy, Window dst_window, Playlist *playlist, PlayerOptions *options)
+{
+  Player *player = NULL;
+
+  if ((player = g_new0(Player, 1)) != NULL) {
+    player->options = (*options);
+    player->state = PLAYER_STATE_IDLE;
+    player->dpy = dpy;
+    player->dst_window = dst_window;
+    player->playlist = playlist;
+    player_setup_video_sink(player);
+    player_select_variants(player);
+
+    if (player->options.persistent && !g_str_equal(player->options.video_pipeline_str, DEFAULT_VIDEO_PIPELINE_STR)) {
+      g_warning("player_new: --persistent requires the default video pipeline, ignoring it\n");
+      player->options.persistent = FALSE;
+    }
+
+    if (g_str_equal(player->options.video_pipeline_str, DEFAULT_VIDEO_PIPELINE_STR) ||
+        g_str_equal(player->options.audio_pipeline_str, DEFAULT_AUDIO_PIPELINE_STR))
+      player->media_info = media_info_cache_load(player->options.media_cache_file);
+
+#ifdef HAVE_MCE
+    mce_connect(player);
+#endif /* HAVE_MCE */
+  }
+
+  return player;
+}
+
+/* Start playing the configured logos. done() is called from the main loop once they are over. */
+void
+player_start(Player *player, PlayerDoneFunc done, gpointer user_data)
+{
+  player->done = done;
+  player->done_data = user_data;
+  player->state = PLAYER_STATE_PLAYING;
+  g_debug("player_start: %u logos, %d ms in all (-1: depends on the media)",
+          playlist_get_length(player->playlist), playlist_get_total_duration(player->playlist));
+
+  /* Prerolling pipelines get the window from their streaming threads */
+  if ((player->options.lookahead || player->options.persistent) && 0 == player->dst_window)
+    player->dst_window = get_dst_window(player->dpy);
+
+  if (player->options.persistent)
+    player->advance_id = g_idle_add_full(G_PRIORITY_HIGH, (GSourceFunc)persistent_start, player, NULL);
+  else
+    player->advance_id = g_idle_add_full(G_PRIORITY_HIGH, (GSourceFunc)player_advance, player, NULL);
+}
+
+/* End the logo on screen now and go on with the next one */
+gboolean
+player_skip(Player *player)
+{
+  if (PLAYER_STATE_PLAYING != player->state)
+    return FALSE;
+
+  if (player->pp) {
+    gst_element_post_message(player->pp->logo->pipeline,
+      gst_message_new_application(GST_OBJECT(player->pp->logo->pipeline), gst_structure_empty_new(LOGO_CUT_MESSAGE)));
+    trace_instant("skip", player->pp->current ? player->pp->current->uri : NULL);
+  }
+  else
+  if (player->current) {
+    trace_instant("skip", player->current->name);
+    logo_finish(player->current);
+  }
+
+  return TRUE;
+}
+
+/* Leave the screen black and finish without playing the remaining logos */
+gboolean
+player_stop(Player *player)
+{
+  Logo *logo = player->pp ? player->pp->logo : player->current;
+
+  if (PLAYER_STATE_PLAYING != player->state)
+    return FALSE;
+
+  if (player->advance_id) {
+    g_source_remove(player->advance_id);
+    player->advance_id = 0;
+  }
+  if (player->preload_id) {
+    g_source_remove(player->preload_id);
+    player->preload_id = 0;
+  }
+
+  if (logo) {
+    gst_element_set_state(logo->pipeline, GST_STATE_PAUSED);
+    clock_timeout_remove(&(logo->kill_to));
+    clock_timeout_remove(&(logo->play_to));
+  }
+  if (player->dst_window)
+    draw_black(player->dpy, player->dst_window);
+
+  trace_instant("stop", NULL);
+  player_finish(player);
+  return TRUE;
+}
+
+/*
+ * Describe the progress as "playing <n> <position> <duration> <remaining>
+ * <file>", with times in milliseconds and -1 for what is not known, or as
+ * "idle" or "finished".
+ */
+char *
+player_get_status(Player *player)
+{
+  GstFormat format = GST_FORMAT_TIME;
+  Logo *logo = player->pp ? player->pp->logo : player->current;
+  const char *name = NULL;
+  gint64 position = -1, duration = -1, remaining = -1;
+
+  if (PLAYER_STATE_IDLE == player->state)
+    return g_strdup("idle");
+  if (PLAYER_STATE_FINISHED == player->state || !logo)
+    return g_strdup("finished");
+
+  name = player->pp ? (player->pp->current ? player->pp->current->uri : "") : logo->name;
+
+  if (!gst_element_query_position(logo->pipeline, &format, &position) || GST_FORMAT_TIME != format)
+    position = -1;
+  else
+    position /= GST_MSECOND;
+
+  if (logo->duration > 0)
+    duration = logo->duration;
+  else {
+    format = GST_FORMAT_TIME;
+    if (gst_element_query_duration(logo->pipeline, &format, &duration) && GST_FORMAT_TIME == format && duration >= 0)
+      duration /= GST_MSECOND;
+    else
+      duration = -1;
+  }
+
+  if (position >= 0 && duration >= 0)
+    remaining = MAX(duration - position, 0);
+
+  return g_strdup_printf("playing %u %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %s",
+                         player->n_started, position, duration, remaining, name ? name : "");
+}
+
+void
+player_destroy(Player *player)
+{
+  if (!player) return;
+
+  if (player->advance_id)
+    g_source_remove(player->advance_id);
+  if (player->preload_id)
+    g_source_remove(player->preload_id);
+  if (player->snapshot_job) {
+    g_thread_join(player->snapshot_thread);
+    g_source_remove_by_user_data(player->snapshot_job);
+    poster_snapshot_free(player->snapshot_job->snapshot);
+    g_free(player->snapshot_job);
+  }
+
+  /* Prevent the green flash before the application quits */
+  if (player->dst_window)
+    draw_black(player->dpy, player->dst_window);
+
+  persistent_free(player->pp);
+  logo_free(player->next);
+  logo_free(player->current);
+  logo_free(player->old);
+
+  /* The sinks may still be using the window */
+  reaper_flush(REAPER_TIMEOUT_MS);
+
+  if (player->dst_window)
+    release_dst_window(player->dpy, player->dst_window);
+
+#ifdef HAVE_MCE
+  mce_disconnect(player);
+#endif /* HAVE_MCE */
+  media_info_cache_free(player->media_info);
+  g_free(player->video_sink_str);
+  g_free(player);
+}
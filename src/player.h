@@ -0,0 +1,82 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _PLAYER_H_
+#define _PLAYER_H_
+
+#include <glib.h>
+#include <X11/Xlib.h>
+#include "conffile.h"
+
+G_BEGIN_DECLS
+
+#define DEFAULT_VIDEO_PIPELINE_STR " playbin2 uri=file://%s " /* " flags=99 " <-- doesn't work with still images */
+#define DEFAULT_AUDIO_PIPELINE_STR " filesrc location=%s use-mmap=true ! decodebin2 ! autoaudiosink "
+#define DEFAULT_SHUSH_PIPELINE_STR " audiotestsrc ! volume volume=0 ! autoaudiosink "
+#define SILENT_PROFILE "silent"
+#define VIDEO_SINK_CACHE_FILE LOCALSTATEDIR "/cache/" PACKAGE_NAME "/videosink"
+
+#define PLAYER_OPTIONS_STATIC_INIT {                  \
+  .video_pipeline_str = DEFAULT_VIDEO_PIPELINE_STR,   \
+  .audio_pipeline_str = DEFAULT_AUDIO_PIPELINE_STR,   \
+  .shush_pipeline_str = DEFAULT_SHUSH_PIPELINE_STR,   \
+  .lookahead = FALSE,                                 \
+  .persistent = FALSE,                                \
+  .snapshot = FALSE,                                  \
+  .silent = FALSE,                                    \
+  .media_cache_file = NULL,                           \
+  .video_sink_cache_file = NULL                       \
+}
+
+typedef struct
+{
+  char *video_pipeline_str;
+  char *audio_pipeline_str;
+  char *shush_pipeline_str;
+  gboolean lookahead;
+  gboolean persistent;
+  gboolean snapshot;
+  gboolean silent; /* The silent profile is active */
+  char *media_cache_file; /* NULL for the system media cache */
+  char *video_sink_cache_file; /* NULL for the system video sink choice */
+} PlayerOptions;
+
+typedef struct _Player Player;
+
+typedef void (*PlayerDoneFunc)(gpointer user_data);
+
+Window get_dst_window(Display *dpy);
+Window release_dst_window(Display *dpy, Window wnd);
+gboolean player_video_sink_cache_update(Display *dpy, const char *cache_file);
+void player_connect_system_bus();
+
+Player *player_new(Display *dpy, Window dst_window, Playlist *playlist, PlayerOptions *options);
+void player_start(Player *player, PlayerDoneFunc done, gpointer user_data);
+gboolean player_skip(Player *player);
+gboolean player_stop(Player *player);
+char *player_get_status(Player *player);
+void player_destroy(Player *player);
+
+G_END_DECLS
+
+#endif /* !_PLAYER_H_ */
@@ -0,0 +1,490 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <gst/gst.h>
+#include "poster.h"
+
+/*
+ * The poster is the first frame of the first logo, already scaled to the
+ * window and converted to the screen's pixel format, so that it can be
+ * handed to XPutImage() as it is. The header is followed by the path of
+ * the video it was taken from and, at data_offset, by the pixels. A poster
+ * with POSTER_FLAG_FAILED has no pixels: it records that no frame could be
+ * taken from that video, so that it is not tried again on every boot.
+ */
+#define POSTER_MAGIC 0x50504857 /* "WHPP" */
+#define POSTER_VERSION 2
+#define POSTER_FLAG_FAILED (1 << 0)
+#define POSTER_PREROLL_TIMEOUT (10 * GST_SECOND)
+#define CONVERT_TAIL "ffmpegcolorspace ! videoscale ! capsfilter name=filter ! fakesink name=sink"
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  gint64 source_mtime;
+  gint64 source_size;
+  guint32 width;
+  guint32 height;
+  guint32 depth;
+  guint32 bits_per_pixel;
+  guint32 bytes_per_line;
+  guint32 byte_order;
+  guint32 red_mask;
+  guint32 green_mask;
+  guint32 blue_mask;
+  guint32 path_length;
+  guint32 data_offset;
+  guint32 flags;
+  guint32 reserved;
+} PosterHeader;
+
+typedef struct
+{
+  Visual *visual;
+  int width;
+  int height;
+  int depth;
+  int bits_per_pixel;
+  int byte_order;
+} PosterFormat;
+
+static gboolean
+poster_format_get(Display *dpy, Window wnd, PosterFormat *fmt)
+{
+  XWindowAttributes attrs;
+  XPixmapFormatValues *formats = NULL;
+  int n_formats = 0, Nix;
+
+  if (!XGetWindowAttributes(dpy, wnd, &attrs))
+    return FALSE;
+
+  fmt->visual = attrs.visual;
+  fmt->width = attrs.width;
+  fmt->height = attrs.height;
+  fmt->depth = attrs.depth;
+  fmt->bits_per_pixel = 0;
+  fmt->byte_order = ImageByteOrder(dpy);
+
+  if ((formats = XListPixmapFormats(dpy, &n_formats)) != NULL) {
+    for (Nix = 0 ; Nix < n_formats ; Nix++)
+      if (formats[Nix].depth == fmt->depth)
+        fmt->bits_per_pixel = formats[Nix].bits_per_pixel;
+    XFree(formats);
+  }
+
+  /* Only true colour formats map directly onto GStreamer RGB caps */
+  return (fmt->bits_per_pixel >= 16 && TrueColor == fmt->visual->class);
+}
+
+static guint32
+poster_bytes_per_line(const PosterFormat *fmt)
+{
+  return GST_ROUND_UP_4(fmt->width * fmt->bits_per_pixel / 8);
+}
+
+static gboolean
+source_stat(const char *path, gint64 *p_mtime, gint64 *p_size)
+{
+  struct stat st;
+
+  if (g_stat(path, &st) != 0)
+    return FALSE;
+
+  (*p_mtime) = (gint64)(st.st_mtime);
+  (*p_size) = (gint64)(st.st_size);
+  return TRUE;
+}
+
+/*
+ * Map the poster if it fits the screen format and its source is unchanged.
+ * If video is given, the poster must also have been taken from it.
+ */
+static char *
+poster_map(const PosterFormat *fmt, const char *video, gsize *p_size)
+{
+  const PosterHeader *header = NULL;
+  const char *path = NULL;
+  struct stat st;
+  gint64 mtime = 0, size = 0;
+  char *map = NULL;
+  int fd = -1;
+
+  if ((fd = open(POSTER_FILE, O_RDONLY)) < 0)
+    return NULL;
+
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PosterHeader)) {
+    close(fd);
+    return NULL;
+  }
+
+  /* Private and writable, in case Xlib wants to touch the pixels */
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == map)
+    return NULL;
+
+  header = (const PosterHeader *)map;
+  path = map + sizeof(PosterHeader);
+  if (header->magic == POSTER_MAGIC &&
+      header->version == POSTER_VERSION &&
+      header->width == fmt->width &&
+      header->height == fmt->height &&
+      header->depth == fmt->depth &&
+      header->bits_per_pixel == fmt->bits_per_pixel &&
+      header->bytes_per_line == poster_bytes_per_line(fmt) &&
+      header->byte_order == fmt->byte_order &&
+      header->red_mask == fmt->visual->red_mask &&
+      header->green_mask == fmt->visual->green_mask &&
+      header->blue_mask == fmt->visual->blue_mask &&
+      /* Bounded by subtraction and division, as sums could wrap on 32 bits */
+      header->data_offset <= (gsize)(st.st_size) &&
+      header->data_offset >= sizeof(PosterHeader) &&
+      header->path_length > 0 &&
+      header->path_length <= header->data_offset - sizeof(PosterHeader) &&
+      ((header->flags & POSTER_FLAG_FAILED) ||
+       (header->bytes_per_line > 0 &&
+        header->height <= ((gsize)(st.st_size) - header->data_offset) / header->bytes_per_line)) &&
+      0 == path[header->path_length - 1] &&
+      (!video || !strcmp(video, path)) &&
+      source_stat(path, &mtime, &size) &&
+      mtime == header->source_mtime &&
+      size == header->source_size) {
+    (*p_size) = st.st_size;
+    return map;
+  }
+
+  munmap(map, st.st_size);
+  return NULL;
+}
+
+/* Paint the cached poster onto the window. Needs nothing but Xlib. */
+gboolean
+poster_show(Display *dpy, Window wnd)
+{
+  const PosterHeader *header = NULL;
+  PosterFormat fmt;
+  XImage *image = NULL;
+  char *map = NULL;
+  gsize size = 0;
+  GC gc;
+
+  if (!poster_format_get(dpy, wnd, &fmt))
+    return FALSE;
+
+  if ((map = poster_map(&fmt, NULL, &size)) == NULL) {
+    g_debug("poster_show: No usable poster for %dx%dx%d", fmt.width, fmt.height, fmt.depth);
+    return FALSE;
+  }
+
+  header = (const PosterHeader *)map;
+  if (header->flags & POSTER_FLAG_FAILED)
+    g_debug("poster_show: No frame could be taken from %s", map + sizeof(PosterHeader));
+  else
+  if ((image = XCreateImage(dpy, fmt.visual, fmt.depth, ZPixmap, 0, map + header->data_offset,
+                            fmt.width, fmt.height, 32, header->bytes_per_line)) != NULL) {
+    gc = XCreateGC(dpy, wnd, 0, NULL);
+    XPutImage(dpy, wnd, gc, image, 0, 0, 0, 0, fmt.width, fmt.height);
+    XFreeGC(dpy, gc);
+    XFlush(dpy);
+    /* The pixels belong to the mapping */
+    image->data = NULL;
+    XDestroyImage(image);
+    g_debug("poster_show: Painted poster");
+  }
+
+  munmap(map, size);
+  return (image != NULL);
+}
+
+/* Describe the screen format as the RGB caps ximagesink would use for it */
+static GstCaps *
+poster_format_caps(const PosterFormat *fmt)
+{
+  guint32 red_mask = fmt->visual->red_mask,
+          green_mask = fmt->visual->green_mask,
+          blue_mask = fmt->visual->blue_mask;
+  int endianness = (LSBFirst == fmt->byte_order) ? G_LITTLE_ENDIAN : G_BIG_ENDIAN;
+
+  if ((24 == fmt->bits_per_pixel || 32 == fmt->bits_per_pixel) && G_LITTLE_ENDIAN == endianness) {
+    endianness = G_BIG_ENDIAN;
+    red_mask = GUINT32_TO_BE(red_mask);
+    green_mask = GUINT32_TO_BE(green_mask);
+    blue_mask = GUINT32_TO_BE(blue_mask);
+    if (24 == fmt->bits_per_pixel) {
+      red_mask >>= 8;
+      green_mask >>= 8;
+      blue_mask >>= 8;
+    }
+  }
+
+  return gst_caps_new_simple("video/x-raw-rgb",
+    "bpp", G_TYPE_INT, fmt->bits_per_pixel,
+    "depth", G_TYPE_INT, fmt->depth,
+    "endianness", G_TYPE_INT, endianness,
+    "red_mask", G_TYPE_INT, (int)red_mask,
+    "green_mask", G_TYPE_INT, (int)green_mask,
+    "blue_mask", G_TYPE_INT, (int)blue_mask,
+    "width", G_TYPE_INT, fmt->width,
+    "height", G_TYPE_INT, fmt->height,
+    NULL);
+}
+
+/*
+ * Preroll a pipeline ending in "capsfilter name=filter ! fakesink name=sink"
+ * and return its first frame, converted to the screen format. A frame to
+ * convert is pushed into the element named "src".
+ */
+static GstBuffer *
+convert_frame(const char *description, GstBuffer *frame, const PosterFormat *fmt)
+{
+  GstElement *pipeline = NULL, *src = NULL, *filter = NULL, *sink = NULL;
+  GstFlowReturn flow = GST_FLOW_OK;
+  GstBuffer *buffer = NULL;
+  GstCaps *caps = NULL;
+
+  if ((pipeline = gst_parse_launch(description, NULL)) == NULL)
+    return NULL;
+
+  if (frame)
+    if ((src = gst_bin_get_by_name(GST_BIN(pipeline), "src")) != NULL) {
+      g_object_set(G_OBJECT(src), "caps", GST_BUFFER_CAPS(frame), NULL);
+      /* appsrc queues both until the pipeline starts */
+      g_signal_emit_by_name(src, "push-buffer", frame, &flow);
+      g_signal_emit_by_name(src, "end-of-stream", &flow);
+      gst_object_unref(src);
+    }
+
+  filter = gst_bin_get_by_name(GST_BIN(pipeline), "filter");
+  sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+  if (filter && sink && (src || !frame)) {
+    caps = poster_format_caps(fmt);
+    g_object_set(G_OBJECT(filter), "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    if (GST_STATE_CHANGE_SUCCESS == gst_element_get_state(pipeline, NULL, NULL, POSTER_PREROLL_TIMEOUT))
+      g_object_get(G_OBJECT(sink), "last-buffer", &buffer, NULL);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+  }
+
+  if (filter)
+    gst_object_unref(filter);
+  if (sink)
+    gst_object_unref(sink);
+  gst_object_unref(pipeline);
+
+  return buffer;
+}
+
+/* Decode the first frame of video, converted to the screen format */
+static GstBuffer *
+grab_first_frame(const char *video, const PosterFormat *fmt)
+{
+  GstBuffer *buffer = NULL;
+  char *description = NULL;
+
+  description = g_strdup_printf("filesrc location=\"%s\" ! decodebin2 ! " CONVERT_TAIL, video);
+  buffer = convert_frame(description, NULL, fmt);
+  g_free(description);
+
+  return buffer;
+}
+
+struct _PosterSnapshot
+{
+  PosterFormat fmt;
+  GstBuffer *frame;
+  GstBuffer *buffer;
+};
+
+/*
+ * Start making a decoded frame the background of the window, so that the X
+ * server keeps it on screen after the pipeline that decoded it is gone.
+ * NULL if the window's format is not one the frame can be converted to.
+ */
+PosterSnapshot *
+poster_snapshot_new(Display *dpy, Window wnd, GstBuffer *frame)
+{
+  PosterSnapshot *snapshot = NULL;
+
+  if (!(frame && GST_BUFFER_CAPS(frame)))
+    return NULL;
+
+  if ((snapshot = g_new0(PosterSnapshot, 1)) != NULL) {
+    if (!poster_format_get(dpy, wnd, &(snapshot->fmt))) {
+      g_free(snapshot);
+      return NULL;
+    }
+    snapshot->frame = gst_buffer_ref(frame);
+  }
+
+  return snapshot;
+}
+
+/* Convert the frame to the screen format. Needs no X, so it may run in any thread. */
+gboolean
+poster_snapshot_convert(PosterSnapshot *snapshot)
+{
+  if ((snapshot->buffer = convert_frame("appsrc name=src ! " CONVERT_TAIL, snapshot->frame, &(snapshot->fmt))) == NULL)
+    g_debug("poster_snapshot_convert: Failed to convert the frame");
+
+  return (snapshot->buffer != NULL);
+}
+
+/* Set the converted frame as the background, repainting the window with it if clear */
+gboolean
+poster_snapshot_show(PosterSnapshot *snapshot, Display *dpy, Window wnd, gboolean clear)
+{
+  const PosterFormat *fmt = &(snapshot->fmt);
+  XImage *image = NULL;
+  Pixmap pixmap;
+  GC gc;
+
+  if (!(snapshot->buffer) || GST_BUFFER_SIZE(snapshot->buffer) < poster_bytes_per_line(fmt) * fmt->height)
+    return FALSE;
+
+  if ((image = XCreateImage(dpy, fmt->visual, fmt->depth, ZPixmap, 0, (char *)GST_BUFFER_DATA(snapshot->buffer),
+                            fmt->width, fmt->height, 32, poster_bytes_per_line(fmt))) != NULL) {
+    pixmap = XCreatePixmap(dpy, wnd, fmt->width, fmt->height, fmt->depth);
+    gc = XCreateGC(dpy, pixmap, 0, NULL);
+    XPutImage(dpy, pixmap, gc, image, 0, 0, 0, 0, fmt->width, fmt->height);
+    XFreeGC(dpy, gc);
+    /* The window keeps the pixmap alive for as long as it needs it */
+    XSetWindowBackgroundPixmap(dpy, wnd, pixmap);
+    XFreePixmap(dpy, pixmap);
+    if (clear)
+      XClearWindow(dpy, wnd);
+    XFlush(dpy);
+    /* The pixels belong to the buffer */
+    image->data = NULL;
+    XDestroyImage(image);
+  }
+
+  return (image != NULL);
+}
+
+void
+poster_snapshot_free(PosterSnapshot *snapshot)
+{
+  if (!snapshot) return;
+  if (snapshot->frame)
+    gst_buffer_unref(snapshot->frame);
+  if (snapshot->buffer)
+    gst_buffer_unref(snapshot->buffer);
+  g_free(snapshot);
+}
+
+/*
+ * Make sure the poster shows the first frame of video for this screen,
+ * regenerating it if needed. A failure is recorded in the poster file and
+ * not retried until the video or the screen changes. Requires GStreamer to
+ * be initialised.
+ */
+gboolean
+poster_update(Display *dpy, Window wnd, const char *video)
+{
+  PosterHeader header;
+  PosterFormat fmt;
+  GstBuffer *buffer = NULL;
+  GString *image = NULL;
+  char *map = NULL, *dir = NULL;
+  gsize size = 0;
+  gboolean ret = FALSE;
+
+  if (!(video && video[0]) || !poster_format_get(dpy, wnd, &fmt))
+    return FALSE;
+
+  if ((map = poster_map(&fmt, video, &size)) != NULL) {
+    ret = !(((const PosterHeader *)map)->flags & POSTER_FLAG_FAILED);
+    munmap(map, size);
+    return ret;
+  }
+
+  /* Decoding is the expensive part: do not do it for nothing */
+  dir = g_path_get_dirname(POSTER_FILE);
+  if (g_mkdir_with_parents(dir, 0755) != 0 || g_access(dir, W_OK) != 0) {
+    g_debug("poster_update: Cannot write to %s", dir);
+    g_free(dir);
+    return FALSE;
+  }
+  g_free(dir);
+
+  g_debug("poster_update: Taking a new poster from %s", video);
+
+  memset(&header, 0, sizeof(header));
+  header.magic = POSTER_MAGIC;
+  header.version = POSTER_VERSION;
+  header.width = fmt.width;
+  header.height = fmt.height;
+  header.depth = fmt.depth;
+  header.bits_per_pixel = fmt.bits_per_pixel;
+  header.bytes_per_line = poster_bytes_per_line(&fmt);
+  header.byte_order = fmt.byte_order;
+  header.red_mask = fmt.visual->red_mask;
+  header.green_mask = fmt.visual->green_mask;
+  header.blue_mask = fmt.visual->blue_mask;
+  header.path_length = strlen(video) + 1;
+  header.data_offset = GST_ROUND_UP_4(sizeof(PosterHeader) + header.path_length);
+
+  if (!source_stat(video, &(header.source_mtime), &(header.source_size)))
+    return FALSE;
+
+  if ((buffer = grab_first_frame(video, &fmt)) == NULL)
+    g_warning("poster_update: Failed to decode a frame from %s\n", video);
+  else
+  if (GST_BUFFER_SIZE(buffer) < header.bytes_per_line * header.height) {
+    g_warning("poster_update: Frame from %s is too small\n", video);
+    gst_buffer_unref(buffer);
+    buffer = NULL;
+  }
+  if (!buffer)
+    header.flags |= POSTER_FLAG_FAILED;
+
+  image = g_string_sized_new(header.data_offset + (buffer ? header.bytes_per_line * header.height : 0));
+  g_string_append_len(image, (const char *)&header, sizeof(header));
+  g_string_append_len(image, video, header.path_length);
+  while (image->len < header.data_offset)
+    g_string_append_c(image, 0);
+  if (buffer)
+    g_string_append_len(image, (const char *)GST_BUFFER_DATA(buffer), header.bytes_per_line * header.height);
+
+  if (g_file_set_contents(POSTER_FILE, image->str, image->len, NULL))
+    ret = (buffer != NULL);
+  else
+    g_warning("poster_update: Failed to write %s\n", POSTER_FILE);
+  g_string_free(image, TRUE);
+
+  if (buffer)
+    gst_buffer_unref(buffer);
+  return ret;
+}
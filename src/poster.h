@@ -0,0 +1,46 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _POSTER_H_
+#define _POSTER_H_
+
+#include <glib.h>
+#include <X11/Xlib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define POSTER_FILE LOCALSTATEDIR "/cache/" PACKAGE_NAME "/poster.raw"
+
+typedef struct _PosterSnapshot PosterSnapshot;
+
+gboolean poster_show(Display *dpy, Window wnd);
+gboolean poster_update(Display *dpy, Window wnd, const char *video);
+PosterSnapshot *poster_snapshot_new(Display *dpy, Window wnd, GstBuffer *frame);
+gboolean poster_snapshot_convert(PosterSnapshot *snapshot);
+gboolean poster_snapshot_show(PosterSnapshot *snapshot, Display *dpy, Window wnd, gboolean clear);
+void poster_snapshot_free(PosterSnapshot *snapshot);
+
+G_END_DECLS
+
+#endif /* !_POSTER_H_ */
@@ -0,0 +1,219 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include "trace.h"
+#include "readahead.h"
+
+/*
+ * The manifest lists, one "<offset> <length> <path>" line per range, the
+ * parts of files a run had in the page cache when it ended: the libraries
+ * and plugins it had mapped, and the media and caches it had read. Taken
+ * on a cold boot, that is what the boot reads from flash. Replaying it
+ * asks the kernel for all of it at once, from a thread of its own, before
+ * the player gets to fault it in page by page.
+ */
+
+/* Ranges closer than this are read as one */
+#define READAHEAD_MERGE_PAGES 16
+
+static gboolean recording = FALSE;
+static GSList *noted = NULL;
+
+static gpointer
+replay_thread(char *manifest)
+{
+  FILE *file = NULL;
+  char line[1024], *path = NULL, *last_path = NULL;
+  long long offset = 0, length = 0;
+  int fd = -1, n_ranges = 0;
+  gint64 start = trace_now();
+
+  if ((file = fopen(manifest, "r")) != NULL) {
+    while (fgets(line, sizeof(line), file) != NULL) {
+      g_strchomp(line);
+      if (sscanf(line, "%lld %lld", &offset, &length) != 2 || (path = strchr(line, '/')) == NULL)
+        continue;
+      /* Ranges of a file come one after the other */
+      if (!last_path || strcmp(path, last_path)) {
+        if (fd >= 0)
+          close(fd);
+        g_free(last_path);
+        last_path = g_strdup(path);
+        fd = open(path, O_RDONLY);
+      }
+      if (fd >= 0 && 0 == posix_fadvise(fd, (off_t)offset, (off_t)length, POSIX_FADV_WILLNEED))
+        n_ranges++;
+    }
+    if (fd >= 0)
+      close(fd);
+    g_free(last_path);
+    fclose(file);
+  }
+
+  trace_complete("readahead", start, manifest);
+  g_debug("replay_thread: Requested %d ranges", n_ranges);
+  g_free(manifest);
+
+  return NULL;
+}
+
+/* Start reading the files in the manifest, if there is one, in the background */
+void
+readahead_replay(const char *manifest)
+{
+  char *path = NULL;
+
+  if (!g_file_test(manifest, G_FILE_TEST_IS_REGULAR))
+    return;
+
+  path = g_strdup(manifest);
+  if (g_thread_create((GThreadFunc)replay_thread, path, FALSE, NULL) == NULL)
+    g_free(path);
+}
+
+/* Collect the files noted from now on for readahead_record_end() */
+void
+readahead_record_begin()
+{
+  recording = TRUE;
+}
+
+/* A file the player read, which the manifest should cover. Only absolute paths count. */
+void
+readahead_note(const char *path)
+{
+  if (recording && path && '/' == path[0] && !g_slist_find_custom(noted, path, (GCompareFunc)strcmp))
+    noted = g_slist_append(noted, g_strdup(path));
+}
+
+/* Note every file mapped into the process: libraries, plugins and the like */
+static void
+note_mapped_files()
+{
+  FILE *file = NULL;
+  char line[1024], *path = NULL;
+
+  if ((file = fopen("/proc/self/maps", "r")) != NULL) {
+    while (fgets(line, sizeof(line), file) != NULL) {
+      g_strchomp(line);
+      /* Anonymous mappings have no path, deleted files are of no use */
+      if ((path = strchr(line, '/')) != NULL && !g_str_has_suffix(path, " (deleted)"))
+        readahead_note(path);
+    }
+    fclose(file);
+  }
+}
+
+/* Append the ranges of path that are in the page cache to manifest */
+static void
+append_resident_ranges(GString *manifest, const char *path)
+{
+  struct stat st;
+  long page_size = sysconf(_SC_PAGESIZE);
+  gsize n_pages, Nix, first = 0, last = 0;
+  gboolean in_range = FALSE;
+  unsigned char *vec = NULL;
+  void *map = NULL;
+  int fd = -1;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return;
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || 0 == st.st_size) {
+    close(fd);
+    return;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == map)
+    return;
+
+  n_pages = (st.st_size + page_size - 1) / page_size;
+  vec = g_malloc(n_pages);
+  if (0 == mincore(map, st.st_size, (void *)vec)) {
+    for (Nix = 0 ; Nix <= n_pages ; Nix++) {
+      if (Nix < n_pages && (vec[Nix] & 1)) {
+        if (in_range && Nix - last > READAHEAD_MERGE_PAGES) {
+          g_string_append_printf(manifest, "%lld %lld %s\n",
+            (long long)first * page_size, (long long)(last - first + 1) * page_size, path);
+          in_range = FALSE;
+        }
+        if (!in_range)
+          first = Nix;
+        last = Nix;
+        in_range = TRUE;
+      }
+      else
+      if (Nix == n_pages && in_range)
+        g_string_append_printf(manifest, "%lld %lld %s\n",
+          (long long)first * page_size, (long long)(last - first + 1) * page_size, path);
+    }
+  }
+
+  g_free(vec);
+  munmap(map, st.st_size);
+}
+
+/*
+ * Write the manifest from what the files noted since readahead_record_begin()
+ * and the files mapped right now have in the page cache.
+ */
+gboolean
+readahead_record_end(const char *manifest)
+{
+  GString *contents = g_string_new("");
+  GSList *itr = NULL, *read_files = noted;
+  char *dir = NULL;
+  gboolean ret = FALSE;
+
+  /* Mapped files come first: gst_init() needs them before any media */
+  noted = NULL;
+  note_mapped_files();
+  noted = g_slist_concat(noted, read_files);
+  for (itr = noted ; itr ; itr = itr->next)
+    append_resident_ranges(contents, itr->data);
+
+  dir = g_path_get_dirname(manifest);
+  if (g_mkdir_with_parents(dir, 0755) == 0 &&
+      g_file_set_contents(manifest, contents->str, contents->len, NULL))
+    ret = TRUE;
+  else
+    g_warning("readahead_record_end: Failed to write %s\n", manifest);
+
+  g_free(dir);
+  g_string_free(contents, TRUE);
+  g_slist_foreach(noted, (GFunc)g_free, NULL);
+  g_slist_free(noted);
+  noted = NULL;
+  recording = FALSE;
+
+  return ret;
+}
@@ -0,0 +1,40 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _READAHEAD_H_
+#define _READAHEAD_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define READAHEAD_MANIFEST LOCALSTATEDIR "/cache/" PACKAGE_NAME "/readahead.manifest"
+
+void readahead_replay(const char *manifest);
+void readahead_record_begin();
+void readahead_note(const char *path);
+gboolean readahead_record_end(const char *manifest);
+
+G_END_DECLS
+
+#endif /* !_READAHEAD_H_ */
@@ -0,0 +1,195 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <glib.h>
+#include <gst/gst.h>
+#include "trace.h"
+#include "reaper.h"
+
+/*
+ * Bringing a pipeline down to NULL waits for its streaming threads and its
+ * sinks to shut down, which can take a while with pulseaudio or X. The
+ * reaper thread does it instead of the main loop, so that finishing one
+ * logo never delays the start of the next.
+ */
+
+typedef struct
+{
+  GstElement *pipeline;
+  char *name;
+  GDestroyNotify notify;
+  gpointer data;
+} ReaperItem;
+
+static GAsyncQueue *queue = NULL;
+static GThread *thread = NULL;
+static GMutex *lock = NULL;
+static GCond *idle_cond = NULL;
+static guint pending = 0;
+
+/* How long teardowns have taken */
+static guint n_reaped = 0;
+static gint64 total_us = 0;
+static gint64 max_us = 0;
+
+/* Pushed by reaper_stop() to end the thread */
+static ReaperItem stop_item;
+
+static void
+reap(ReaperItem *item)
+{
+  gint64 start = trace_now(), duration;
+
+  gst_element_set_state(item->pipeline, GST_STATE_NULL);
+  gst_object_unref(item->pipeline);
+  /* No streaming thread is left to use the data */
+  if (item->notify)
+    item->notify(item->data);
+  duration = trace_now() - start;
+  trace_complete("reap", start, item->name);
+  g_debug("reap: Tore down %s in %" G_GINT64_FORMAT " us", item->name ? item->name : "pipeline", duration);
+
+  if (lock)
+    g_mutex_lock(lock);
+  n_reaped++;
+  total_us += duration;
+  if (duration > max_us)
+    max_us = duration;
+  if (lock) {
+    pending--;
+    g_cond_broadcast(idle_cond);
+    g_mutex_unlock(lock);
+  }
+
+  g_free(item->name);
+  g_free(item);
+}
+
+static gpointer
+reaper_thread(gpointer null)
+{
+  ReaperItem *item = NULL;
+
+  while ((item = g_async_queue_pop(queue)) != &stop_item)
+    reap(item);
+
+  return NULL;
+}
+
+/* Start the reaper thread. Without it, pipelines are torn down on the spot. */
+void
+reaper_start()
+{
+  if (thread) return;
+
+  queue = g_async_queue_new();
+  lock = g_mutex_new();
+  idle_cond = g_cond_new();
+  if ((thread = g_thread_create(reaper_thread, NULL, TRUE, NULL)) == NULL) {
+    g_warning("reaper_start: Failed to create the reaper thread\n");
+    g_async_queue_unref(queue); queue = NULL;
+    g_mutex_free(lock); lock = NULL;
+    g_cond_free(idle_cond); idle_cond = NULL;
+  }
+}
+
+/*
+ * Bring the pipeline down to NULL and drop the reference to it, in the
+ * background. notify, if not NULL, is then called with data, from the
+ * reaper thread.
+ */
+void
+reaper_reap(GstElement *pipeline, const char *name, GDestroyNotify notify, gpointer data)
+{
+  ReaperItem *item = NULL;
+
+  if (!pipeline) {
+    if (notify)
+      notify(data);
+    return;
+  }
+
+  item = g_new0(ReaperItem, 1);
+  item->pipeline = pipeline;
+  item->name = g_strdup(name);
+  item->notify = notify;
+  item->data = data;
+
+  if (thread) {
+    g_mutex_lock(lock);
+    pending++;
+    g_mutex_unlock(lock);
+    g_async_queue_push(queue, item);
+  }
+  else
+    reap(item);
+}
+
+/* Wait up to timeout_ms for the pipelines handed over so far. Returns FALSE on timeout. */
+gboolean
+reaper_flush(guint timeout_ms)
+{
+  GTimeVal deadline;
+  gboolean ret = TRUE;
+
+  if (!thread) return TRUE;
+
+  g_get_current_time(&deadline);
+  g_time_val_add(&deadline, ((glong)timeout_ms) * 1000);
+
+  g_mutex_lock(lock);
+  while (pending > 0 && g_cond_timed_wait(idle_cond, lock, &deadline));
+  ret = (0 == pending);
+  g_mutex_unlock(lock);
+
+  if (!ret)
+    g_warning("reaper_flush: %u teardowns still running after %u ms\n", pending, timeout_ms);
+
+  return ret;
+}
+
+/*
+ * End the reaper thread once it has nothing left to do. If the teardowns
+ * do not finish within timeout_ms, the thread is left behind and FALSE is
+ * returned: GStreamer must not be deinitialised then.
+ */
+gboolean
+reaper_stop(guint timeout_ms)
+{
+  if (!thread) return TRUE;
+
+  if (!reaper_flush(timeout_ms))
+    return FALSE;
+
+  g_async_queue_push(queue, &stop_item);
+  g_thread_join(thread);
+  thread = NULL;
+  g_async_queue_unref(queue); queue = NULL;
+  g_mutex_free(lock); lock = NULL;
+  g_cond_free(idle_cond); idle_cond = NULL;
+
+  g_debug("reaper_stop: Tore down %u pipelines in %" G_GINT64_FORMAT " us, the slowest in %" G_GINT64_FORMAT " us",
+          n_reaped, total_us, max_us);
+
+  return TRUE;
+}
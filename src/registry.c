@@ -0,0 +1,318 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include "conffile.h"
+#include "mediainfo.h"
+#include "registry.h"
+
+/*
+ * The private registry only knows about the plugins the configured logos
+ * need: the player's own elements, the elements recorded in the media
+ * cache, and the sinks the auto sinks would pick. The plugins are
+ * symlinked into a directory of their own, and a child process started
+ * with only that directory in its plugin path writes the registry. The
+ * mtimes of the configuration directory and of the media cache it was
+ * built from are stamped next to it: once either has changed, the logos
+ * may need plugins the registry lacks.
+ */
+
+static const char *player_elements[] = {
+  "filesrc", "appsrc", "queue", "capsfilter", "fakesink", "typefind",
+  "playbin2", "uridecodebin", "decodebin2",
+  "ffmpegcolorspace", "videoscale", "xvimagesink", "ximagesink", "autovideosink",
+  "audioconvert", "audioresample", "volume", "audiotestsrc", "autoaudiosink",
+  NULL
+};
+
+static const char *player_plugins[] = {
+  "typefindfunctions",
+  NULL
+};
+
+static void
+add_plugin(GHashTable *plugins, const char *plugin_name)
+{
+  GstPlugin *plugin = NULL;
+
+  if ((plugin = gst_registry_find_plugin(gst_registry_get_default(), plugin_name)) != NULL) {
+    if (gst_plugin_get_filename(plugin))
+      g_hash_table_insert(plugins, g_strdup(gst_plugin_get_filename(plugin)), NULL);
+    gst_object_unref(plugin);
+  }
+}
+
+static void
+add_element(GHashTable *plugins, const char *element)
+{
+  GstElementFactory *factory = NULL;
+
+  if (!element) return;
+
+  if ((factory = gst_element_factory_find(element)) != NULL) {
+    add_plugin(plugins, GST_PLUGIN_FEATURE(factory)->plugin_name);
+    gst_object_unref(factory);
+  }
+}
+
+static gboolean
+add_media(GHashTable *plugins, MediaInfoCache *cache, const char *path)
+{
+  const MediaInfo *info = NULL;
+
+  if ((info = media_info_cache_lookup(cache, path)) == NULL) {
+    g_warning("add_media: %s has not been probed\n", path);
+    return FALSE;
+  }
+
+  add_element(plugins, info->demuxer);
+  add_element(plugins, info->video_parser);
+  add_element(plugins, info->video_decoder);
+  add_element(plugins, info->audio_parser);
+  add_element(plugins, info->audio_decoder);
+
+  return TRUE;
+}
+
+static gboolean
+is_sink_of_class(GstPluginFeature *feature, const char *klass)
+{
+  return (GST_IS_ELEMENT_FACTORY(feature) &&
+          strstr(gst_element_factory_get_klass(GST_ELEMENT_FACTORY(feature)), klass) != NULL &&
+          gst_plugin_feature_get_rank(feature) >= GST_RANK_MARGINAL);
+}
+
+/* Add the plugin of the highest ranked sink of the given class, as an auto sink would pick it */
+static void
+add_best_sink(GHashTable *plugins, const char *klass)
+{
+  GList *features = NULL, *itr = NULL;
+  GstPluginFeature *best = NULL;
+
+  features = gst_registry_get_feature_list(gst_registry_get_default(), GST_TYPE_ELEMENT_FACTORY);
+  for (itr = features ; itr ; itr = itr->next)
+    if (is_sink_of_class(itr->data, klass))
+      if (!best || gst_plugin_feature_get_rank(itr->data) > gst_plugin_feature_get_rank(best))
+        best = itr->data;
+
+  if (best)
+    add_plugin(plugins, best->plugin_name);
+  gst_plugin_feature_list_free(features);
+}
+
+/* Collect the file names of the plugins needed. FALSE if a logo's media is unknown. */
+static gboolean
+collect_plugins(GHashTable *plugins)
+{
+  Playlist *playlist = NULL;
+  const PlaylistEntry *entry = NULL;
+  MediaInfoCache *cache = NULL;
+  guint Nix1;
+  int Nix;
+  gboolean ret = TRUE;
+
+  for (Nix = 0 ; player_elements[Nix] ; Nix++)
+    add_element(plugins, player_elements[Nix]);
+  for (Nix = 0 ; player_plugins[Nix] ; Nix++)
+    add_plugin(plugins, player_plugins[Nix]);
+  add_best_sink(plugins, "Sink/Video");
+  add_best_sink(plugins, "Sink/Audio");
+
+  if ((cache = media_info_cache_load(NULL)) == NULL || (playlist = playlist_new()) == NULL) {
+    media_info_cache_free(cache);
+    return FALSE;
+  }
+
+  for (Nix1 = 0 ; (entry = playlist_get_entry(playlist, Nix1)) != NULL ; Nix1++) {
+    if (entry->video && entry->video[0])
+      ret = add_media(plugins, cache, entry->video) && ret;
+    for (Nix = 0 ; entry->variants && entry->variants[Nix] && entry->variants[Nix + 1] ; Nix += 2)
+      ret = add_media(plugins, cache, entry->variants[Nix + 1]) && ret;
+    if (entry->audio && entry->audio[0] && !('s' == entry->audio[0] && 0 == entry->audio[1]))
+      ret = add_media(plugins, cache, entry->audio) && ret;
+  }
+
+  playlist_free(playlist);
+  media_info_cache_free(cache);
+
+  return ret;
+}
+
+static void
+remove_private_registry()
+{
+  GDir *dir = NULL;
+  const char *fname = NULL;
+  char *file = NULL;
+
+  if ((dir = g_dir_open(PRIVATE_PLUGIN_DIR, 0, NULL)) != NULL) {
+    while ((fname = g_dir_read_name(dir)) != NULL) {
+      file = g_build_filename(PRIVATE_PLUGIN_DIR, fname, NULL);
+      g_unlink(file);
+      g_free(file);
+    }
+    g_dir_close(dir);
+  }
+  g_rmdir(PRIVATE_PLUGIN_DIR);
+  g_unlink(PRIVATE_REGISTRY_FILE);
+  g_unlink(PRIVATE_REGISTRY_STAMP_FILE);
+}
+
+static gboolean
+file_mtime(const char *path, gint64 *p_mtime)
+{
+  struct stat st;
+
+  if (g_stat(path, &st) != 0)
+    return FALSE;
+
+  (*p_mtime) = (gint64)(st.st_mtime);
+  return TRUE;
+}
+
+/* "<configuration directory mtime> <media cache mtime>" */
+static char *
+registry_stamp()
+{
+  char *conf_dir = g_build_filename(SYSCONFDIR, PACKAGE_NAME ".d", NULL);
+  char *stamp = NULL;
+  gint64 conf_mtime = 0, cache_mtime = 0;
+
+  if (file_mtime(conf_dir, &conf_mtime) && file_mtime(MEDIA_INFO_CACHE_FILE, &cache_mtime))
+    stamp = g_strdup_printf("%" G_GINT64_FORMAT " %" G_GINT64_FORMAT, conf_mtime, cache_mtime);
+  g_free(conf_dir);
+
+  return stamp;
+}
+
+static void
+link_plugin(char *filename, gpointer null, gboolean *p_ok)
+{
+  char *base = g_path_get_basename(filename);
+  char *link = g_build_filename(PRIVATE_PLUGIN_DIR, base, NULL);
+
+  if (symlink(filename, link) != 0) {
+    g_warning("link_plugin: Failed to link %s\n", filename);
+    (*p_ok) = FALSE;
+  }
+
+  g_free(link);
+  g_free(base);
+}
+
+/*
+ * Point GStreamer at the private registry, if there is one and the logos
+ * have not changed since it was built. Must be called before gst_init().
+ */
+gboolean
+private_registry_use()
+{
+  char *stamp = NULL, *recorded = NULL;
+  gboolean current = FALSE;
+
+  if (!g_file_test(PRIVATE_REGISTRY_FILE, G_FILE_TEST_IS_REGULAR))
+    return FALSE;
+
+  if ((stamp = registry_stamp()) != NULL && g_file_get_contents(PRIVATE_REGISTRY_STAMP_FILE, &recorded, NULL, NULL))
+    current = g_str_equal(stamp, g_strstrip(recorded));
+  g_free(recorded);
+  g_free(stamp);
+  if (!current) {
+    g_debug("private_registry_use: %s is out of date, using the system registry", PRIVATE_REGISTRY_FILE);
+    return FALSE;
+  }
+
+  g_debug("private_registry_use: Using %s", PRIVATE_REGISTRY_FILE);
+  g_setenv("GST_REGISTRY", PRIVATE_REGISTRY_FILE, TRUE);
+  g_setenv("GST_PLUGIN_SYSTEM_PATH", PRIVATE_PLUGIN_DIR, TRUE);
+  g_setenv("GST_REGISTRY_UPDATE", "no", TRUE);
+  g_unsetenv("GST_PLUGIN_PATH");
+
+  return TRUE;
+}
+
+/*
+ * Rebuild the private registry from the media cache. Requires GStreamer to
+ * be initialised with the system registry. Without complete information
+ * about the logos, the private registry is removed and the system one is
+ * used instead.
+ */
+gboolean
+private_registry_update()
+{
+  GHashTable *plugins = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  /* The installed binary: under maemo-launcher, /proc/self/exe is the launcher */
+  char *argv[] = { BINDIR "/" PACKAGE_NAME, "--" PRIVATE_REGISTRY_BUILD_OPTION, NULL };
+  char *stamp = NULL;
+  gboolean ok = TRUE;
+  int status = -1;
+
+  remove_private_registry();
+
+  /* Taken before collecting, so that a concurrent change invalidates the result */
+  if ((stamp = registry_stamp()) == NULL) {
+    g_warning("private_registry_update: Cannot stat the configuration or the media cache\n");
+    g_hash_table_destroy(plugins);
+    return FALSE;
+  }
+
+  if (!collect_plugins(plugins)) {
+    g_warning("private_registry_update: Not all logos are known, using the system registry\n");
+    g_hash_table_destroy(plugins);
+    g_free(stamp);
+    return FALSE;
+  }
+
+  if (g_mkdir_with_parents(PRIVATE_PLUGIN_DIR, 0755) != 0) {
+    g_hash_table_destroy(plugins);
+    g_free(stamp);
+    return FALSE;
+  }
+  g_hash_table_foreach(plugins, (GHFunc)link_plugin, &ok);
+  g_debug("private_registry_update: %d plugins", g_hash_table_size(plugins));
+  g_hash_table_destroy(plugins);
+
+  /* The child scans only the private plugins and writes the registry as it starts up */
+  if (ok) {
+    g_setenv("GST_REGISTRY", PRIVATE_REGISTRY_FILE, TRUE);
+    g_setenv("GST_PLUGIN_SYSTEM_PATH", PRIVATE_PLUGIN_DIR, TRUE);
+    g_setenv("GST_REGISTRY_UPDATE", "yes", TRUE);
+    g_unsetenv("GST_PLUGIN_PATH");
+    ok = g_spawn_sync(NULL, argv, NULL, 0, NULL, NULL, NULL, NULL, &status, NULL) && 0 == status &&
+         g_file_test(PRIVATE_REGISTRY_FILE, G_FILE_TEST_IS_REGULAR) &&
+         g_file_set_contents(PRIVATE_REGISTRY_STAMP_FILE, stamp, -1, NULL);
+  }
+  g_free(stamp);
+
+  if (!ok) {
+    g_warning("private_registry_update: Failed to build %s\n", PRIVATE_REGISTRY_FILE);
+    remove_private_registry();
+  }
+
+  return ok;
+}
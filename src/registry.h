@@ -0,0 +1,42 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _REGISTRY_H_
+#define _REGISTRY_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define PRIVATE_REGISTRY_DIR LOCALSTATEDIR "/cache/" PACKAGE_NAME "/gst"
+#define PRIVATE_REGISTRY_FILE PRIVATE_REGISTRY_DIR "/registry.bin"
+#define PRIVATE_REGISTRY_STAMP_FILE PRIVATE_REGISTRY_DIR "/registry.stamp"
+#define PRIVATE_PLUGIN_DIR PRIVATE_REGISTRY_DIR "/plugins"
+#define PRIVATE_REGISTRY_BUILD_OPTION "build-registry"
+
+gboolean private_registry_use();
+gboolean private_registry_update();
+
+G_END_DECLS
+
+#endif /* !_REGISTRY_H_ */
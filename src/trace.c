@@ -0,0 +1,172 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "trace.h"
+
+#define TRACE_MAX_EVENTS 512
+#define TRACE_DETAIL_LEN 64
+
+typedef struct
+{
+  const char *name;
+  char phase;
+  gint64 ts;
+  gint64 dur;
+  int tid;
+  char detail[TRACE_DETAIL_LEN];
+  volatile gint committed;
+} TraceEvent;
+
+static TraceEvent events[TRACE_MAX_EVENTS];
+static volatile gint n_events = 0;
+
+/* Microseconds on the monotonic clock */
+gint64
+trace_now()
+{
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    return 0;
+
+  return ((gint64)(ts.tv_sec)) * G_GINT64_CONSTANT(1000000) + ts.tv_nsec / 1000;
+}
+
+/*
+ * Safe to call from any thread: each event gets its own slot, which is
+ * marked committed once filled, so that trace_write() skips slots that
+ * are still being written.
+ */
+static void
+trace_add(const char *name, char phase, gint64 ts, gint64 dur, const char *detail)
+{
+  TraceEvent *event = NULL;
+  gint idx = g_atomic_int_exchange_and_add(&n_events, 1);
+  gsize len = 0;
+  const char *tail = NULL;
+
+  if (idx >= TRACE_MAX_EVENTS)
+    return;
+
+  event = &(events[idx]);
+  event->name = name;
+  event->phase = phase;
+  event->ts = ts;
+  event->dur = dur;
+  event->tid = (int)syscall(SYS_gettid);
+  event->detail[0] = 0;
+  if (detail) {
+    /* Keep the end of long paths, which names the file, from a whole character on */
+    len = strlen(detail);
+    tail = detail + (len >= TRACE_DETAIL_LEN ? len - TRACE_DETAIL_LEN + 1 : 0);
+    if (0x80 == (*tail & 0xc0))
+      tail = g_utf8_find_next_char(tail, NULL);
+    g_strlcpy(event->detail, tail, TRACE_DETAIL_LEN);
+  }
+  /* The fields must be visible before the flag */
+  g_atomic_int_set(&(event->committed), 1);
+}
+
+/* Record a span that started at start, as returned by trace_now(), and ends now */
+void
+trace_complete(const char *name, gint64 start, const char *detail)
+{
+  gint64 now = trace_now();
+
+  trace_add(name, 'X', start, now - start, detail);
+}
+
+void
+trace_instant(const char *name, const char *detail)
+{
+  trace_add(name, 'i', trace_now(), 0, detail);
+}
+
+static void
+write_json_string(FILE *file, const char *str)
+{
+  fputc('"', file);
+  for (; *str ; str++)
+    if ('"' == *str || '\\' == *str)
+      fprintf(file, "\\%c", *str);
+    else
+    if ((unsigned char)(*str) < 0x20)
+      fprintf(file, "\\u%04x", (unsigned char)(*str));
+    else
+      fputc(*str, file);
+  fputc('"', file);
+}
+
+/* Write the recorded events as a trace viewer can load them */
+gboolean
+trace_write(const char *path)
+{
+  FILE *file = NULL;
+  gint Nix, count = MIN(g_atomic_int_get(&n_events), TRACE_MAX_EVENTS);
+  int pid = (int)getpid();
+  gboolean ret = FALSE, first = TRUE;
+
+  if ((file = g_fopen(path, "w")) == NULL) {
+    g_warning("trace_write: Failed to open %s\n", path);
+    return FALSE;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  for (Nix = 0 ; Nix < count ; Nix++) {
+    if (!g_atomic_int_get(&(events[Nix].committed)))
+      continue;
+    fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+    first = FALSE;
+    write_json_string(file, events[Nix].name);
+    fprintf(file, ",\"cat\":\"boot\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d",
+            events[Nix].phase, events[Nix].ts, pid, events[Nix].tid);
+    if ('X' == events[Nix].phase)
+      fprintf(file, ",\"dur\":%" G_GINT64_FORMAT, events[Nix].dur);
+    else
+      fprintf(file, ",\"s\":\"p\"");
+    if (events[Nix].detail[0]) {
+      fprintf(file, ",\"args\":{\"detail\":");
+      write_json_string(file, events[Nix].detail);
+      fputc('}', file);
+    }
+    fputc('}', file);
+  }
+  fprintf(file, "\n]}\n");
+
+  ret = (0 == ferror(file));
+  if (fclose(file) != 0)
+    ret = FALSE;
+  if (!ret)
+    g_warning("trace_write: Failed to write %s\n", path);
+  if (g_atomic_int_get(&n_events) > TRACE_MAX_EVENTS)
+    g_warning("trace_write: Dropped %d events\n", g_atomic_int_get(&n_events) - TRACE_MAX_EVENTS);
+
+  return ret;
+}
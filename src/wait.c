@@ -0,0 +1,106 @@
+/*
+ * This file is part of hildon-welcome 
+ *
+ * Copyright (C) 2009 Nokia Corporation.
+ * 
+ * Author: Gabriel Schulhof <gabriel.schulhof@nokia.com>
+ * Contact: Karoliina T. Salminen <karoliina.t.salminen@nokia.com>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Wait for hildon-welcome to finish: return as soon as FINISHED_FILE
+ * appears, or hildon-welcome is no longer running. inotify wakes us up
+ * when the file is created; the process list is only looked at once in a
+ * while, in case hildon-welcome died before it got that far. Deliberately
+ * depends on nothing but the C library, so that it starts instantly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include "finished.h"
+
+#define PROCESS_NAME "hildon-welcome"
+#define LIVENESS_CHECK_MS 1000
+
+/* Whether any process is called PROCESS_NAME, judging by /proc/<pid>/stat */
+static int
+player_is_running()
+{
+  DIR *proc = NULL;
+  struct dirent *entry = NULL;
+  char path[sizeof("/proc/") + NAME_MAX + sizeof("/stat")], stat[128];
+  FILE *file = NULL;
+  int running = 0;
+
+  if ((proc = opendir("/proc")) == NULL)
+    return 0;
+
+  while (!running && (entry = readdir(proc)) != NULL) {
+    if (entry->d_name[0] < '1' || entry->d_name[0] > '9')
+      continue;
+    snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+    if ((file = fopen(path, "r")) != NULL) {
+      /* "pid (comm) state ..." */
+      if (fgets(stat, sizeof(stat), file) != NULL)
+        running = (strstr(stat, " (" PROCESS_NAME ") ") != NULL);
+      fclose(file);
+    }
+  }
+
+  closedir(proc);
+  return running;
+}
+
+int
+main(void)
+{
+  char dir[] = FINISHED_FILE;
+  struct pollfd pfd;
+  char events[4096];
+
+  pfd.fd = inotify_init();
+  pfd.events = POLLIN;
+
+  /* Watch before looking, so that the file cannot appear in between */
+  if (pfd.fd < 0 || inotify_add_watch(pfd.fd, dirname(dir), IN_CREATE | IN_MOVED_TO) < 0) {
+    perror("hildon-welcome-wait: inotify");
+    if (pfd.fd >= 0)
+      close(pfd.fd);
+    pfd.fd = -1;
+  }
+
+  while (access(FINISHED_FILE, F_OK) != 0 && player_is_running()) {
+    if (pfd.fd < 0)
+      usleep(LIVENESS_CHECK_MS * 1000);
+    else
+    if (poll(&pfd, 1, LIVENESS_CHECK_MS) > 0)
+      if (read(pfd.fd, events, sizeof(events)) < 0)
+        break;
+  }
+
+  if (pfd.fd >= 0)
+    close(pfd.fd);
+
+  return 0;
+}